@@ -0,0 +1,506 @@
+/* monospaceif_bench.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Drives libmonospaceif through synthetic workloads using the recording
+// screen interface and reports ops/sec, backend calls and allocations per
+// workload.
+//
+// Usage: monospaceif_bench [scale] [config-key=value ...]
+//
+// "scale" multiplies the number of iterations of every workload, the
+// configuration values are applied before the workloads start, so that
+// for example "enable-shadow-grid=true" can be measured against the
+// default setup. "native-scroll=true" makes the recording screen offer
+// "scroll_region".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tools/types.h"
+#include "tools/unused.h"
+#include "tools/z_ucs.h"
+#include "interpreter/fizmo.h"
+#include "interpreter/config.h"
+#include "interpreter/history.h"
+#include "screen_interface/screen_interface.h"
+
+#include "../monospace_interface/monospace_interface.h"
+#include "recording_interface.h"
+
+
+#define BENCH_SCREEN_HEIGHT 25
+#define BENCH_SCREEN_WIDTH 80
+#define BENCH_HISTORY_SIZE (16 * 1024 * 1024)
+#define BENCH_HISTORY_INCREMENT (64 * 1024)
+#define BENCH_OUTPUT_BUFFER_SIZE 256
+#define BENCH_INPUT_SIZE 80
+
+struct bench_workload
+{
+  char *name;
+  uint8_t story_version;
+  int iterations;
+  long (*run)(int iterations);
+};
+
+static struct z_story bench_story;
+static z_ucs empty_string[] = { 0 };
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+// The bench is linked with "--wrap" for the allocation functions, see
+// CMakeLists.txt, so that all allocations made by libmonospaceif and a
+// statically linked libfizmo are counted here.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static long nof_allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+  nof_allocations++;
+  return __real_malloc(size);
+}
+
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  nof_allocations++;
+  return __real_calloc(nmemb, size);
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  nof_allocations++;
+  return __real_realloc(ptr, size);
+}
+#endif // BENCH_COUNT_ALLOCATIONS
+
+#ifdef BENCH_NESTED_READS
+// Verification routines are run by the bench instead of libfizmo, see
+// CMakeLists.txt. While "nested_read_input" is set, the routine reads a
+// line itself, like Border Zone does.
+#define BENCH_VERIFICATION_ROUTINE 0x1234
+
+static bool nested_read_enabled = false;
+static zscii nested_read_input[BENCH_INPUT_SIZE + 1];
+static int nested_read_length = 0;
+
+int __wrap_interpret_from_call(uint32_t UNUSED(routine)) {
+  int tenth_seconds_elapsed;
+
+  if (nested_read_enabled == true)
+    nested_read_length = active_interface->read_line(
+        nested_read_input, BENCH_INPUT_SIZE, 0, 0, 0, &tenth_seconds_elapsed,
+        true, false);
+
+  return 0;
+}
+#endif // BENCH_NESTED_READS
+
+
+static char *words[] = {
+  "the", "dungeon", "is", "dark", "and", "you", "are", "likely", "to",
+  "be", "eaten", "by", "a", "grue", "unless", "lamp", "lit", "brass",
+  NULL };
+
+static z_style styles[] = {
+  Z_STYLE_ROMAN, Z_STYLE_BOLD, Z_STYLE_ITALIC, Z_STYLE_REVERSE_VIDEO };
+
+static z_colour colours[] = {
+  Z_COLOUR_BLACK, Z_COLOUR_RED, Z_COLOUR_GREEN, Z_COLOUR_YELLOW,
+  Z_COLOUR_BLUE, Z_COLOUR_MAGENTA, Z_COLOUR_CYAN, Z_COLOUR_WHITE };
+
+
+// Sends output to window 0 the same way libfizmo's stream 1 does: It's
+// stored in the output history -- which is what scrollback and refreshes
+// are rebuilt from -- and passed on to the interface.
+static void bench_output(char *latin1_output) {
+  z_ucs buf[BENCH_OUTPUT_BUFFER_SIZE];
+  int len;
+
+  while (*latin1_output != 0) {
+    len = strlen(latin1_output);
+    if (len > BENCH_OUTPUT_BUFFER_SIZE - 1)
+      len = BENCH_OUTPUT_BUFFER_SIZE - 1;
+    latin1_string_to_zucs_string(buf, latin1_output, len + 1);
+    store_z_ucs_output_in_history(outputhistory[0], buf);
+    active_interface->z_ucs_output(buf);
+    latin1_output += len;
+  }
+}
+
+
+static void output_paragraph(int nof_words, int seed) {
+  int i;
+
+  for (i=0; i<nof_words; i++) {
+    bench_output(words[(seed + i * 7) % (sizeof(words) / sizeof(char*) - 1)]);
+    bench_output(i < nof_words - 1 ? " " : "\n");
+  }
+}
+
+
+// Lets the library flush all buffered output and process the queued events
+// by reading one line of input, just like after a story's turn.
+static void read_input() {
+  zscii input[BENCH_INPUT_SIZE + 1];
+  int tenth_seconds_elapsed;
+
+  active_interface->read_line(
+      input, BENCH_INPUT_SIZE, 0, 0, 0, &tenth_seconds_elapsed, true, false);
+}
+
+
+static long run_long_paragraphs(int iterations) {
+  int i;
+
+  for (i=0; i<iterations; i++)
+    output_paragraph(800, i);
+  read_input();
+
+  return iterations;
+}
+
+
+static long run_style_colour_churn(int iterations) {
+  int i;
+
+  for (i=0; i<iterations; i++) {
+    active_interface->set_text_style(styles[i % 4]);
+    active_interface->set_colour(
+        colours[i % 8], colours[(i / 8 + 1) % 8], 0);
+    bench_output(words[i % (sizeof(words) / sizeof(char*) - 1)]);
+    bench_output(i % 12 == 11 ? "\n" : " ");
+  }
+  active_interface->set_text_style(Z_STYLE_ROMAN);
+  active_interface->set_colour(
+      default_foreground_colour, default_background_colour, 0);
+  read_input();
+
+  return iterations;
+}
+
+
+static long run_scrollback_paging(int iterations) {
+  int i, j;
+
+  for (i=0; i<2000; i++)
+    output_paragraph(10 + i % 60, i);
+  read_input();
+
+  for (i=0; i<iterations; i++) {
+    for (j=0; j<50; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_PAGE_UP, 0);
+    for (j=0; j<50; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_PAGE_DOWN, 0);
+    read_input();
+  }
+
+  return iterations * 100;
+}
+
+
+// Alternates new output with paging, like a player looking back after
+// every turn, so that the history output is discarded on new output and
+// set up again for the next page-up.
+static long run_interleaved_scrollback(int iterations) {
+  int i, j;
+
+  for (i=0; i<300; i++)
+    output_paragraph(10 + i % 60, i);
+  read_input();
+
+  for (i=0; i<iterations; i++) {
+    output_paragraph(10 + i % 60, i);
+    for (j=0; j<3; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_PAGE_UP, 0);
+    for (j=0; j<3; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_PAGE_DOWN, 0);
+    read_input();
+  }
+
+  return iterations * 7;
+}
+
+
+static long run_resize_storm(int iterations) {
+  int i, height, width;
+
+  for (i=0; i<300; i++)
+    output_paragraph(10 + i % 60, i);
+  read_input();
+
+  for (i=0; i<iterations; i++) {
+    height = BENCH_SCREEN_HEIGHT - 10 + i % 20;
+    width = BENCH_SCREEN_WIDTH - 30 + (i * 7) % 60;
+    recording_interface_set_screen_size(height, width);
+    new_monospace_screen_size(height, width);
+    // Resizes arrive in bursts, the library draws them when waiting for
+    // input.
+    if (i % 10 == 9)
+      read_input();
+  }
+
+  recording_interface_set_screen_size(BENCH_SCREEN_HEIGHT, BENCH_SCREEN_WIDTH);
+  new_monospace_screen_size(BENCH_SCREEN_HEIGHT, BENCH_SCREEN_WIDTH);
+  read_input();
+
+  return iterations;
+}
+
+
+// Switches between two widths, like a window on a tiling window manager,
+// and scrolls back at each of them.
+static long run_width_flip(int iterations) {
+  int i, j, width;
+
+  for (i=0; i<300; i++)
+    output_paragraph(10 + i % 60, i);
+  read_input();
+
+  for (i=0; i<iterations; i++) {
+    width = i % 2 == 0 ? BENCH_SCREEN_WIDTH / 2 : BENCH_SCREEN_WIDTH;
+    recording_interface_set_screen_size(BENCH_SCREEN_HEIGHT, width);
+    new_monospace_screen_size(BENCH_SCREEN_HEIGHT, width);
+    for (j=0; j<10; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_PAGE_UP, 0);
+    read_input();
+  }
+
+  return iterations;
+}
+
+
+// Types a line longer than the screen and fixes it like a player fixing a
+// typo: moving back into the line, inserting and deleting there, then
+// jumping to both ends.
+static long run_line_editing(int iterations) {
+  int i, j;
+
+  for (i=0; i<iterations; i++) {
+    for (j=0; j<BENCH_INPUT_SIZE - 10; j++)
+      recording_interface_push_event(EVENT_WAS_INPUT, 'a' + j % 26);
+    for (j=0; j<30; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_CURSOR_LEFT, 0);
+    for (j=0; j<10; j++)
+      recording_interface_push_event(EVENT_WAS_INPUT, 'z');
+    for (j=0; j<10; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_BACKSPACE, 0);
+    for (j=0; j<5; j++)
+      recording_interface_push_event(EVENT_WAS_CODE_DELETE, 0);
+    recording_interface_push_event(EVENT_WAS_CODE_CTRL_A, 0);
+    recording_interface_push_event(EVENT_WAS_CODE_CTRL_E, 0);
+    read_input();
+  }
+
+  return iterations * (BENCH_INPUT_SIZE - 10 + 57);
+}
+
+
+#ifdef BENCH_NESTED_READS
+// Types half a line, lets the timed routine read a line of its own and
+// finishes the outer line, which has to come out unharmed.
+static long run_nested_reads(int iterations) {
+  zscii input[BENCH_INPUT_SIZE + 1];
+  int tenth_seconds_elapsed, length, i, j;
+
+  nested_read_enabled = true;
+
+  for (i=0; i<iterations; i++) {
+    for (j=0; j<5; j++)
+      recording_interface_push_event(EVENT_WAS_INPUT, 'a' + j);
+    recording_interface_push_event(EVENT_WAS_TIMEOUT, 0);
+    for (j=0; j<3; j++)
+      recording_interface_push_event(EVENT_WAS_INPUT, 'x');
+    recording_interface_push_event(EVENT_WAS_INPUT, Z_UCS_NEWLINE);
+    for (j=0; j<5; j++)
+      recording_interface_push_event(EVENT_WAS_INPUT, 'f' + j);
+
+    length = active_interface->read_line(
+        input, BENCH_INPUT_SIZE, 1, BENCH_VERIFICATION_ROUTINE, 0,
+        &tenth_seconds_elapsed, true, false);
+
+    if ( (length != 10) || (memcmp(input, "abcdefghij", 10) != 0)
+        || (nested_read_length != 3)
+        || (memcmp(nested_read_input, "xxx", 3) != 0) ) {
+      fprintf(stderr, "Nested read broke the outer input line.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nested_read_enabled = false;
+
+  return iterations;
+}
+#endif // BENCH_NESTED_READS
+
+
+static long run_status_line_updates(int iterations) {
+  z_ucs room_description[BENCH_OUTPUT_BUFFER_SIZE];
+  int i;
+
+  for (i=0; i<iterations; i++) {
+    latin1_string_to_zucs_string(
+        room_description,
+        i % 2 == 0 ? "West of House" : "Behind House",
+        BENCH_OUTPUT_BUFFER_SIZE);
+    active_interface->show_status(
+        room_description, SCORE_MODE_SCORE_AND_TURN, i % 350, i);
+  }
+  read_input();
+
+  return iterations;
+}
+
+
+static struct bench_workload workloads[] = {
+  { "long-paragraphs", 5, 200, &run_long_paragraphs },
+  { "style-colour-churn", 5, 100000, &run_style_colour_churn },
+  { "scrollback-paging", 5, 20, &run_scrollback_paging },
+  { "interleaved-scrollback", 5, 500, &run_interleaved_scrollback },
+  { "resize-storm", 5, 200, &run_resize_storm },
+  { "width-flip", 5, 200, &run_width_flip },
+  { "line-editing", 5, 200, &run_line_editing },
+#ifdef BENCH_NESTED_READS
+  { "nested-reads", 5, 10, &run_nested_reads },
+#endif // BENCH_NESTED_READS
+  { "status-line-updates", 3, 20000, &run_status_line_updates },
+  { NULL, 0, 0, NULL }
+};
+
+
+// Every workload gets a history of its own, so that its scrollback and
+// refreshes don't depend on the output of the workloads run before it.
+static void open_story(uint8_t story_version) {
+  outputhistory[0] = create_outputhistory(
+      0,
+      BENCH_HISTORY_SIZE,
+      BENCH_HISTORY_INCREMENT,
+      default_foreground_colour,
+      default_background_colour,
+      Z_FONT_NORMAL,
+      Z_STYLE_ROMAN);
+
+  ver = story_version;
+  recording_interface_set_screen_size(BENCH_SCREEN_HEIGHT, BENCH_SCREEN_WIDTH);
+  active_interface->link_interface_to_story(&bench_story);
+}
+
+
+static void close_story() {
+  // A non-NULL error message keeps the library from waiting for a key.
+  active_interface->close_interface(empty_string);
+
+  destroy_outputhistory(outputhistory[0]);
+  outputhistory[0] = NULL;
+}
+
+
+static double get_seconds() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+  struct bench_workload *workload;
+  struct recording_call_counts *counts;
+  struct monospace_interface_memory memory;
+  double start, elapsed;
+  long nof_ops;
+  char allocations_per_op[32];
+#ifdef BENCH_COUNT_ALLOCATIONS
+  long allocations_at_start;
+#endif // BENCH_COUNT_ALLOCATIONS
+  int scale = 1, i;
+  char *separator;
+
+  fizmo_register_screen_monospace_interface(&recording_interface);
+
+  for (i=1; i<argc; i++) {
+    if ((separator = strchr(argv[i], '=')) != NULL) {
+      *separator = 0;
+      if (set_configuration_value(argv[i], separator + 1) != 0) {
+        fprintf(stderr, "Invalid configuration value \"%s\".\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if ((scale = atoi(argv[i])) < 1) {
+      fprintf(stderr, "Usage: %s [scale] [config-key=value ...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("%-22s %10s %14s %14s %12s %10s %10s\n",
+      "workload", "ops", "ops/sec", "calls", "calls/op", "bytes", "allocs/op");
+
+  for (workload=workloads; workload->name != NULL; workload++) {
+    open_story(workload->story_version);
+    recording_interface_reset_call_counts();
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+    allocations_at_start = nof_allocations;
+#endif // BENCH_COUNT_ALLOCATIONS
+    start = get_seconds();
+    nof_ops = workload->run(workload->iterations * scale);
+    elapsed = get_seconds() - start;
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+    snprintf(allocations_per_op, sizeof(allocations_per_op), "%.3f",
+        (double)(nof_allocations - allocations_at_start) / nof_ops);
+#else
+    strcpy(allocations_per_op, "-");
+#endif // BENCH_COUNT_ALLOCATIONS
+
+    counts = recording_interface_get_call_counts();
+    get_monospace_interface_memory(&memory);
+    printf("%-22s %10ld %14.0f %14ld %12.2f %10zu %10s\n",
+        workload->name,
+        nof_ops,
+        elapsed > 0 ? nof_ops / elapsed : 0,
+        counts->total,
+        (double)counts->total / nof_ops,
+        memory.session_total + memory.shared_total,
+        allocations_per_op);
+
+    close_story();
+  }
+
+  recording_interface_free();
+
+  return EXIT_SUCCESS;
+}
+
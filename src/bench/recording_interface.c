@@ -0,0 +1,454 @@
+/* recording_interface.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tools/types.h"
+#include "tools/unused.h"
+#include "tools/z_ucs.h"
+#include "interpreter/fizmo.h"
+
+#include "recording_interface.h"
+
+
+static struct recording_cell *cells = NULL;
+static int screen_height = 25;
+static int screen_width = 80;
+static int cursor_y = 1;
+static int cursor_x = 1;
+static z_style current_style = 0;
+static z_colour current_foreground = Z_COLOUR_WHITE;
+static z_colour current_background = Z_COLOUR_BLACK;
+static struct recording_call_counts call_counts;
+
+static int event_types[RECORDING_INTERFACE_MAX_EVENTS];
+static z_ucs event_inputs[RECORDING_INTERFACE_MAX_EVENTS];
+static int first_event = 0;
+static int nof_events = 0;
+
+static bool native_scroll = false;
+
+static char *config_option_names[] = { "native-scroll", NULL };
+
+
+static void count_call(long *counter) {
+  (*counter)++;
+  call_counts.total++;
+}
+
+
+static void clear_cells(int y, int x, int height, int width) {
+  struct recording_cell *cell;
+  int row, col;
+
+  for (row=y; row<y+height; row++) {
+    if ( (row < 1) || (row > screen_height) )
+      continue;
+    for (col=x; col<x+width; col++) {
+      if ( (col < 1) || (col > screen_width) )
+        continue;
+      cell = &cells[(row - 1) * screen_width + (col - 1)];
+      cell->character = Z_UCS_SPACE;
+      cell->style = current_style;
+      cell->foreground = current_foreground;
+      cell->background = current_background;
+    }
+  }
+}
+
+
+static void allocate_cells() {
+  free(cells);
+  cells = fizmo_malloc(
+      sizeof(struct recording_cell) * screen_height * screen_width);
+  clear_cells(1, 1, screen_height, screen_width);
+}
+
+
+static void goto_yx(int y, int x) {
+  count_call(&call_counts.goto_yx);
+  cursor_y = y;
+  cursor_x = x;
+}
+
+
+static void z_ucs_output_n(const z_ucs *output, size_t length) {
+  struct recording_cell *cell;
+  const z_ucs *output_end = output + length;
+
+  count_call(&call_counts.z_ucs_output);
+
+  while (output < output_end) {
+    if (*output == Z_UCS_NEWLINE) {
+      cursor_y++;
+      cursor_x = 1;
+    }
+    else {
+      if ( (cursor_y >= 1) && (cursor_y <= screen_height)
+          && (cursor_x >= 1) && (cursor_x <= screen_width) ) {
+        cell = &cells[(cursor_y - 1) * screen_width + (cursor_x - 1)];
+        cell->character = *output;
+        cell->style = current_style;
+        cell->foreground = current_foreground;
+        cell->background = current_background;
+      }
+      cursor_x++;
+    }
+    output++;
+  }
+}
+
+
+static void z_ucs_output(z_ucs *output) {
+  z_ucs_output_n(output, z_ucs_len(output));
+}
+
+
+static bool is_input_timeout_available() {
+  count_call(&call_counts.other);
+  return true;
+}
+
+
+static int get_next_event(z_ucs *input, int timeout_millis) {
+  struct timespec timeout;
+  int result;
+
+  count_call(&call_counts.get_next_event);
+
+  if (nof_events == 0) {
+    *input = Z_UCS_NEWLINE;
+    return EVENT_WAS_INPUT;
+  }
+
+  result = event_types[first_event];
+
+  // A queued timeout only arrives once the timeout has passed, just like
+  // it would from a real screen.
+  if ( (result == EVENT_WAS_TIMEOUT) && (timeout_millis > 0) ) {
+    timeout.tv_sec = timeout_millis / 1000;
+    timeout.tv_nsec = (timeout_millis % 1000) * 1000000L;
+    nanosleep(&timeout, NULL);
+  }
+
+  *input = event_inputs[first_event];
+  first_event = (first_event + 1) % RECORDING_INTERFACE_MAX_EVENTS;
+  nof_events--;
+
+  return result;
+}
+
+
+static char *get_interface_name() {
+  return "recording";
+}
+
+
+static bool return_true() {
+  count_call(&call_counts.other);
+  return true;
+}
+
+
+static void scroll_region(int top, int bottom, int lines);
+
+
+// "native-scroll" makes the screen offer "scroll_region". Since the library
+// reads the entry when linking, it has to be set before a story is started.
+// Like all other configuration values, "value" is owned by the callee.
+static int parse_config_parameter(char *key, char *value) {
+  if (strcmp(key, "native-scroll") == 0) {
+    native_scroll
+      = ( (value == NULL) || (*value == 0) || (strcmp(value, "true") == 0) )
+      ? true : false;
+    recording_interface.scroll_region
+      = native_scroll == true ? &scroll_region : NULL;
+    free(value);
+    return 0;
+  }
+
+  return -2;
+}
+
+
+static char *get_config_value(char *key) {
+  if (strcmp(key, "native-scroll") == 0)
+    return native_scroll == true ? "true" : "false";
+
+  return NULL;
+}
+
+
+static char **get_config_option_names() {
+  return config_option_names;
+}
+
+
+static void link_interface_to_story(struct z_story *UNUSED(story)) {
+  if (cells == NULL)
+    allocate_cells();
+}
+
+
+static void reset_interface() {
+}
+
+
+static int close_interface(z_ucs *UNUSED(error_message)) {
+  count_call(&call_counts.other);
+  return 0;
+}
+
+
+static void set_text_style(z_style text_style) {
+  count_call(&call_counts.set_text_style);
+  current_style = text_style;
+}
+
+
+static void set_colour(z_colour foreground, z_colour background) {
+  count_call(&call_counts.set_colour);
+  current_foreground = foreground;
+  current_background = background;
+}
+
+
+static void set_font(z_font UNUSED(font_type)) {
+  count_call(&call_counts.other);
+}
+
+
+static void output_interface_info() {
+}
+
+
+static int get_screen_width() {
+  return screen_width;
+}
+
+
+static int get_screen_height() {
+  return screen_height;
+}
+
+
+static void update_screen() {
+  count_call(&call_counts.update_screen);
+}
+
+
+static void redraw_screen_from_scratch() {
+  count_call(&call_counts.other);
+}
+
+
+static void copy_cells(int dsty, int dstx, int srcy, int srcx, int height,
+    int width) {
+  int row;
+
+  if ( (dsty < 1) || (srcy < 1) || (dstx < 1) || (srcx < 1)
+      || (dsty + height - 1 > screen_height)
+      || (srcy + height - 1 > screen_height)
+      || (dstx + width - 1 > screen_width)
+      || (srcx + width - 1 > screen_width) )
+    return;
+
+  if (dsty <= srcy) {
+    for (row=0; row<height; row++)
+      memmove(
+          &cells[(dsty + row - 1) * screen_width + (dstx - 1)],
+          &cells[(srcy + row - 1) * screen_width + (srcx - 1)],
+          sizeof(struct recording_cell) * width);
+  }
+  else {
+    for (row=height-1; row>=0; row--)
+      memmove(
+          &cells[(dsty + row - 1) * screen_width + (dstx - 1)],
+          &cells[(srcy + row - 1) * screen_width + (srcx - 1)],
+          sizeof(struct recording_cell) * width);
+  }
+}
+
+
+static void copy_area(int dsty, int dstx, int srcy, int srcx, int height,
+    int width) {
+  count_call(&call_counts.copy_area);
+  copy_cells(dsty, dstx, srcy, srcx, height, width);
+}
+
+
+static void scroll_region(int top, int bottom, int lines) {
+  int height = bottom - top + 1;
+
+  count_call(&call_counts.scroll_region);
+
+  if ( (lines >= height) || (-lines >= height) )
+    clear_cells(top, 1, height, screen_width);
+  else if (lines > 0) {
+    copy_cells(top, 1, top + lines, 1, height - lines, screen_width);
+    clear_cells(bottom - lines + 1, 1, lines, screen_width);
+  }
+  else if (lines < 0) {
+    copy_cells(top - lines, 1, top, 1, height + lines, screen_width);
+    clear_cells(top, 1, -lines, screen_width);
+  }
+}
+
+
+static void clear_to_eol() {
+  count_call(&call_counts.clear_to_eol);
+  clear_cells(cursor_y, cursor_x, 1, screen_width - cursor_x + 1);
+}
+
+
+static void clear_area(int startx, int starty, int xsize, int ysize) {
+  count_call(&call_counts.clear_area);
+  clear_cells(starty, startx, ysize, xsize);
+}
+
+
+static void set_cursor_visibility(bool UNUSED(visible)) {
+  count_call(&call_counts.other);
+}
+
+
+static z_colour get_default_foreground_colour() {
+  return Z_COLOUR_WHITE;
+}
+
+
+static z_colour get_default_background_colour() {
+  return Z_COLOUR_BLACK;
+}
+
+
+static int prompt_for_filename(char *UNUSED(filename_suggestion),
+    z_file **UNUSED(result_file), char *UNUSED(directory),
+    int UNUSED(filetype_or_mode), int UNUSED(fileaccess)) {
+  return -3;
+}
+
+
+struct z_screen_monospace_interface recording_interface =
+{
+  &goto_yx,
+  &z_ucs_output,
+  &is_input_timeout_available,
+  NULL,
+  NULL,
+  &get_next_event,
+  &get_interface_name,
+  &return_true,
+  &return_true,
+  &return_true,
+  &parse_config_parameter,
+  &get_config_value,
+  &get_config_option_names,
+  &link_interface_to_story,
+  &reset_interface,
+  &close_interface,
+  &set_text_style,
+  &set_colour,
+  &set_font,
+  &output_interface_info,
+  &get_screen_width,
+  &get_screen_height,
+  &update_screen,
+  &redraw_screen_from_scratch,
+  &copy_area,
+  &clear_to_eol,
+  &clear_area,
+  &set_cursor_visibility,
+  &get_default_foreground_colour,
+  &get_default_background_colour,
+  &prompt_for_filename,
+  NULL,
+  NULL,
+  &z_ucs_output_n,
+  NULL
+};
+
+
+// Changes the screen size reported to libmonospaceif. The contents are lost,
+// so "keeps_contents_on_resize" isn't offered and the library redraws the
+// whole screen after a resize.
+void recording_interface_set_screen_size(int height, int width) {
+  screen_height = height;
+  screen_width = width;
+  if (cursor_y > screen_height)
+    cursor_y = screen_height;
+  if (cursor_x > screen_width)
+    cursor_x = screen_width;
+  allocate_cells();
+}
+
+
+void recording_interface_push_event(int event_type, z_ucs input) {
+  int index;
+
+  if (nof_events == RECORDING_INTERFACE_MAX_EVENTS)
+    return;
+
+  index = (first_event + nof_events) % RECORDING_INTERFACE_MAX_EVENTS;
+  event_types[index] = event_type;
+  event_inputs[index] = input;
+  nof_events++;
+}
+
+
+void recording_interface_reset_call_counts() {
+  memset(&call_counts, 0, sizeof(struct recording_call_counts));
+}
+
+
+struct recording_call_counts *recording_interface_get_call_counts() {
+  return &call_counts;
+}
+
+
+struct recording_cell *recording_interface_get_cell(int y, int x) {
+  if ( (cells == NULL) || (y < 1) || (y > screen_height)
+      || (x < 1) || (x > screen_width) )
+    return NULL;
+
+  return &cells[(y - 1) * screen_width + (x - 1)];
+}
+
+
+void recording_interface_free() {
+  free(cells);
+  cells = NULL;
+}
+
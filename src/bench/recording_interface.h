@@ -0,0 +1,81 @@
+/* recording_interface.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef recording_interface_h_INCLUDED
+#define recording_interface_h_INCLUDED
+
+#include "tools/types.h"
+#include "../screen_interface/screen_monospace_interface.h"
+
+// An in-memory screen which stores every cell written to it and counts the
+// calls it receives from libmonospaceif. Input is taken from a queue of
+// events filled by the caller; once the queue is empty, every read is
+// answered with a newline so that pending input always terminates.
+
+#define RECORDING_INTERFACE_MAX_EVENTS 4096
+
+struct recording_cell
+{
+  z_ucs character;
+  z_style style;
+  z_colour foreground;
+  z_colour background;
+};
+
+struct recording_call_counts
+{
+  long goto_yx;
+  long z_ucs_output;
+  long set_text_style;
+  long set_colour;
+  long copy_area;
+  long scroll_region;
+  long clear_to_eol;
+  long clear_area;
+  long update_screen;
+  long get_next_event;
+  long other;
+  long total;
+};
+
+extern struct z_screen_monospace_interface recording_interface;
+
+void recording_interface_set_screen_size(int height, int width);
+void recording_interface_push_event(int event_type, z_ucs input);
+void recording_interface_reset_call_counts();
+struct recording_call_counts *recording_interface_get_call_counts();
+struct recording_cell *recording_interface_get_cell(int y, int x);
+void recording_interface_free();
+
+#endif /* recording_interface_h_INCLUDED */
+
@@ -0,0 +1,265 @@
+/* draw_op_batch.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "tools/z_ucs.h"
+
+#include "draw_op_batch.h"
+#include "draw_op_buffer.h"
+
+
+static struct z_screen_monospace_interface *target = NULL;
+static struct z_screen_monospace_interface batch_interface;
+static struct draw_op_buffer buffer;
+static z_style current_style = 0;
+
+
+static void flush_ops() {
+  if (buffer.nof_ops > 0) {
+    TRACE_LOG("Sending %d draw ops.\n", buffer.nof_ops);
+    target->draw_ops(buffer.ops, buffer.nof_ops);
+    draw_op_buffer_clear(&buffer);
+  }
+}
+
+
+static struct z_screen_draw_op *append_op(int type) {
+  struct z_screen_draw_op *result;
+
+  if ((result = draw_op_buffer_append(&buffer, type)) == NULL) {
+    flush_ops();
+    result = draw_op_buffer_append(&buffer, type);
+  }
+
+  return result;
+}
+
+
+static void batch_goto_yx(int y, int x) {
+  struct z_screen_draw_op *op;
+
+  // A cursor movement directly following another one replaces it.
+  if ( (buffer.nof_ops > 0)
+      && (buffer.ops[buffer.nof_ops - 1].type == DRAW_OP_GOTO_YX) )
+    op = &buffer.ops[buffer.nof_ops - 1];
+  else
+    op = append_op(DRAW_OP_GOTO_YX);
+
+  op->y = y;
+  op->x = x;
+}
+
+
+static void batch_z_ucs_output_n(const z_ucs *output, size_t length) {
+  int stored;
+
+  while (length > 0) {
+    stored = draw_op_buffer_append_text(&buffer, output, length,
+        current_style);
+    if (stored == 0)
+      flush_ops();
+    output += stored;
+    length -= stored;
+  }
+}
+
+
+static void batch_z_ucs_output(z_ucs *output) {
+  batch_z_ucs_output_n(output, z_ucs_len(output));
+}
+
+
+static void batch_set_text_style(z_style text_style) {
+  current_style = text_style;
+}
+
+
+static void batch_set_colour(z_colour foreground, z_colour background) {
+  struct z_screen_draw_op *op = append_op(DRAW_OP_SET_COLOUR);
+
+  op->foreground = foreground;
+  op->background = background;
+}
+
+
+static void batch_copy_area(int dsty, int dstx, int srcy, int srcx,
+    int height, int width) {
+  struct z_screen_draw_op *op = append_op(DRAW_OP_COPY_AREA);
+
+  op->y = dsty;
+  op->x = dstx;
+  op->srcy = srcy;
+  op->srcx = srcx;
+  op->height = height;
+  op->width = width;
+}
+
+
+static void batch_clear_to_eol() {
+  struct z_screen_draw_op *op = append_op(DRAW_OP_CLEAR_TO_EOL);
+
+  op->text_style = current_style;
+}
+
+
+static void batch_clear_area(int startx, int starty, int xsize, int ysize) {
+  struct z_screen_draw_op *op = append_op(DRAW_OP_CLEAR_AREA);
+
+  op->y = starty;
+  op->x = startx;
+  op->height = ysize;
+  op->width = xsize;
+  op->text_style = current_style;
+}
+
+
+static void batch_scroll_region(int top, int bottom, int lines) {
+  flush_ops();
+  target->scroll_region(top, bottom, lines);
+}
+
+
+static void batch_set_font(z_font font_type) {
+  flush_ops();
+  target->set_font(font_type);
+}
+
+
+static void batch_output_interface_info() {
+  flush_ops();
+  target->output_interface_info();
+}
+
+
+static void batch_update_screen() {
+  flush_ops();
+  target->update_screen();
+}
+
+
+static void batch_redraw_screen_from_scratch() {
+  flush_ops();
+  target->redraw_screen_from_scratch();
+}
+
+
+static void batch_set_cursor_visibility(bool visible) {
+  flush_ops();
+  target->set_cursor_visibility(visible);
+}
+
+
+static int batch_get_next_event(z_ucs *input, int timeout_millis) {
+  if (buffer.nof_ops > 0) {
+    flush_ops();
+    target->update_screen();
+  }
+
+  return target->get_next_event(input, timeout_millis);
+}
+
+
+static int batch_close_interface(z_ucs *error_message) {
+  // The last output has to be visible before the backend shuts down.
+  flush_ops();
+  target->update_screen();
+  return target->close_interface(error_message);
+}
+
+
+static int batch_prompt_for_filename(char *filename_suggestion,
+    z_file **result_file, char *directory, int filetype_or_mode,
+    int fileaccess) {
+  flush_ops();
+  return target->prompt_for_filename(filename_suggestion, result_file,
+      directory, filetype_or_mode, fileaccess);
+}
+
+
+struct z_screen_monospace_interface *draw_op_batch_wrap_interface(
+    struct z_screen_monospace_interface *new_target) {
+  if (target != NULL)
+    return &batch_interface;
+
+  TRACE_LOG("Activating draw op batching.\n");
+
+  target = new_target;
+  draw_op_buffer_init(&buffer);
+  current_style = 0;
+
+  batch_interface = *target;
+  batch_interface.goto_yx = &batch_goto_yx;
+  batch_interface.z_ucs_output = &batch_z_ucs_output;
+  batch_interface.z_ucs_output_n = &batch_z_ucs_output_n;
+  batch_interface.set_text_style = &batch_set_text_style;
+  batch_interface.set_colour = &batch_set_colour;
+  batch_interface.copy_area = &batch_copy_area;
+  batch_interface.clear_to_eol = &batch_clear_to_eol;
+  batch_interface.clear_area = &batch_clear_area;
+  batch_interface.set_font = &batch_set_font;
+  batch_interface.output_interface_info = &batch_output_interface_info;
+  if (target->scroll_region != NULL)
+    batch_interface.scroll_region = &batch_scroll_region;
+  batch_interface.update_screen = &batch_update_screen;
+  batch_interface.redraw_screen_from_scratch
+    = &batch_redraw_screen_from_scratch;
+  batch_interface.set_cursor_visibility = &batch_set_cursor_visibility;
+  batch_interface.get_next_event = &batch_get_next_event;
+  batch_interface.close_interface = &batch_close_interface;
+  if (target->prompt_for_filename != NULL)
+    batch_interface.prompt_for_filename = &batch_prompt_for_filename;
+
+  // Layers wrapping this interface must not bypass the batch.
+  batch_interface.draw_ops = NULL;
+
+  return &batch_interface;
+}
+
+
+struct z_screen_monospace_interface *draw_op_batch_unwrap_interface() {
+  struct z_screen_monospace_interface *result = target;
+
+  draw_op_buffer_free(&buffer);
+  target = NULL;
+
+  return result;
+}
+
+
+size_t draw_op_batch_get_memory_size() {
+  return draw_op_buffer_get_memory_size(&buffer);
+}
+
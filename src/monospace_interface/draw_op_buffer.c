@@ -0,0 +1,121 @@
+/* draw_op_buffer.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "tools/types.h"
+#include "interpreter/fizmo.h"
+
+#include "draw_op_buffer.h"
+
+
+void draw_op_buffer_init(struct draw_op_buffer *buffer) {
+  buffer->ops = fizmo_malloc(
+      sizeof(struct z_screen_draw_op) * DRAW_OP_BUFFER_MAX_OPS);
+  buffer->text = fizmo_malloc(sizeof(z_ucs) * DRAW_OP_BUFFER_TEXT_SIZE);
+  buffer->nof_ops = 0;
+  buffer->text_used = 0;
+}
+
+
+void draw_op_buffer_free(struct draw_op_buffer *buffer) {
+  free(buffer->ops);
+  free(buffer->text);
+  buffer->ops = NULL;
+  buffer->text = NULL;
+  buffer->nof_ops = 0;
+  buffer->text_used = 0;
+}
+
+
+size_t draw_op_buffer_get_memory_size(struct draw_op_buffer *buffer) {
+  return buffer->ops != NULL
+    ? sizeof(struct z_screen_draw_op) * DRAW_OP_BUFFER_MAX_OPS
+      + sizeof(z_ucs) * DRAW_OP_BUFFER_TEXT_SIZE
+    : 0;
+}
+
+
+void draw_op_buffer_clear(struct draw_op_buffer *buffer) {
+  buffer->nof_ops = 0;
+  buffer->text_used = 0;
+}
+
+
+struct z_screen_draw_op *draw_op_buffer_append(struct draw_op_buffer *buffer,
+    int type) {
+  struct z_screen_draw_op *result;
+
+  if (buffer->nof_ops == DRAW_OP_BUFFER_MAX_OPS)
+    return NULL;
+
+  result = &buffer->ops[buffer->nof_ops++];
+  memset(result, 0, sizeof(struct z_screen_draw_op));
+  result->type = type;
+
+  return result;
+}
+
+
+int draw_op_buffer_append_text(struct draw_op_buffer *buffer,
+    const z_ucs *text, int length, z_style text_style) {
+  struct z_screen_draw_op *op = NULL;
+
+  if (length > DRAW_OP_BUFFER_TEXT_SIZE - buffer->text_used)
+    length = DRAW_OP_BUFFER_TEXT_SIZE - buffer->text_used;
+
+  if (length <= 0)
+    return 0;
+
+  if (buffer->nof_ops > 0) {
+    op = &buffer->ops[buffer->nof_ops - 1];
+    if ( (op->type != DRAW_OP_TEXT)
+        || (op->text_style != text_style)
+        || (op->text + op->text_length != buffer->text + buffer->text_used) )
+      op = NULL;
+  }
+
+  if (op == NULL) {
+    if ((op = draw_op_buffer_append(buffer, DRAW_OP_TEXT)) == NULL)
+      return 0;
+    op->text = buffer->text + buffer->text_used;
+    op->text_style = text_style;
+  }
+
+  memcpy(buffer->text + buffer->text_used, text, sizeof(z_ucs) * length);
+  buffer->text_used += length;
+  op->text_length += length;
+
+  return length;
+}
+
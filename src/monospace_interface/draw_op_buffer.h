@@ -0,0 +1,72 @@
+/* draw_op_buffer.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef draw_op_buffer_h_INCLUDED
+#define draw_op_buffer_h_INCLUDED
+
+#include "tools/types.h"
+#include "../screen_interface/screen_monospace_interface.h"
+
+// A fixed-size list of drawing operations with a pool for their text. Since
+// the storage is never re-allocated, text pointers stay valid until the
+// buffer is cleared.
+
+#define DRAW_OP_BUFFER_MAX_OPS 1024
+#define DRAW_OP_BUFFER_TEXT_SIZE 16384
+
+struct draw_op_buffer {
+  struct z_screen_draw_op *ops;
+  int nof_ops;
+  z_ucs *text;
+  int text_used;
+};
+
+void draw_op_buffer_init(struct draw_op_buffer *buffer);
+void draw_op_buffer_free(struct draw_op_buffer *buffer);
+void draw_op_buffer_clear(struct draw_op_buffer *buffer);
+size_t draw_op_buffer_get_memory_size(struct draw_op_buffer *buffer);
+
+// Returns a new, zero-initialized operation or NULL in case the buffer is
+// full.
+struct z_screen_draw_op *draw_op_buffer_append(struct draw_op_buffer *buffer,
+    int type);
+
+// Appends a text operation, merging it with the preceding operation in
+// case that one is text of the same style. Returns the number of chars
+// which could be stored, which may be less than "length" when the buffer
+// is full.
+int draw_op_buffer_append_text(struct draw_op_buffer *buffer,
+    const z_ucs *text, int length, z_style text_style);
+
+#endif /* draw_op_buffer_h_INCLUDED */
+
@@ -0,0 +1,268 @@
+/* input_line.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "interpreter/fizmo.h"
+
+#include "input_line.h"
+#include "z_ucs_span.h"
+
+
+// Unchanged cells between two changed ones are sent again as long as there
+// are fewer than this, since that's cheaper than another "goto_yx".
+#define INPUT_LINE_MAX_RESENT_CELLS 4
+
+// The input text is stored in "text", with the unused space kept as a gap
+// at the last edit position. Moving the gap only has to move the chars
+// between the old and the new position. "text_size" is the capacity kept
+// across lines, "line_size" the maximum length of the current line, which
+// the text and the gap are limited to.
+static z_ucs *text = NULL;
+static int text_size = 0;
+static int line_size = 0;
+static int gap_start = 0;
+static int gap_end = 0;
+
+// The cells of the input line as they are on-screen, 0 if unknown.
+static z_ucs *shown = NULL;
+static z_ucs *row = NULL;
+static int shown_size = 0;
+
+
+static void move_gap(int index) {
+  if (index < gap_start) {
+    memmove(
+        text + gap_end - (gap_start - index),
+        text + index,
+        sizeof(z_ucs) * (gap_start - index));
+    gap_end -= gap_start - index;
+    gap_start = index;
+  }
+  else if (index > gap_start) {
+    memmove(
+        text + gap_start,
+        text + gap_end,
+        sizeof(z_ucs) * (index - gap_start));
+    gap_end += index - gap_start;
+    gap_start = index;
+  }
+}
+
+
+static void ensure_display_width(int display_width) {
+  int i;
+
+  if (display_width <= shown_size)
+    return;
+
+  shown = fizmo_realloc(shown, sizeof(z_ucs) * display_width);
+  row = fizmo_realloc(row, sizeof(z_ucs) * display_width);
+  for (i=shown_size; i<display_width; i++)
+    shown[i] = 0;
+  shown_size = display_width;
+}
+
+
+static z_ucs get_cell(int index) {
+  return index < input_line_get_length()
+    ? input_line_get_char(index)
+    : Z_UCS_SPACE;
+}
+
+
+void input_line_reset(int maximum_length) {
+  if (maximum_length > text_size) {
+    text = fizmo_realloc(text, sizeof(z_ucs) * maximum_length);
+    text_size = maximum_length;
+  }
+
+  line_size = maximum_length;
+  gap_start = 0;
+  gap_end = line_size;
+}
+
+
+// Only called for nested reads, so the allocation doesn't matter.
+void input_line_save(struct input_line_state *state) {
+  int i;
+
+  state->length = input_line_get_length();
+  state->maximum_length = line_size;
+  state->text = NULL;
+
+  if (state->length > 0) {
+    state->text = fizmo_malloc(sizeof(z_ucs) * state->length);
+    for (i=0; i<state->length; i++)
+      state->text[i] = input_line_get_char(i);
+  }
+}
+
+
+void input_line_restore(struct input_line_state *state) {
+  int i;
+
+  input_line_reset(state->maximum_length);
+  if (state->length > 0)
+    memcpy(text, state->text, sizeof(z_ucs) * state->length);
+  gap_start = state->length;
+
+  free(state->text);
+  state->text = NULL;
+
+  // The nested line may have been drawn anywhere.
+  for (i=0; i<shown_size; i++)
+    shown[i] = 0;
+}
+
+
+int input_line_get_length() {
+  return line_size - (gap_end - gap_start);
+}
+
+
+z_ucs input_line_get_char(int index) {
+  return index < gap_start
+    ? text[index]
+    : text[index + gap_end - gap_start];
+}
+
+
+void input_line_insert(int index, z_ucs input) {
+  if (gap_start == gap_end) {
+    TRACE_LOG("Input line full, dropping char %d.\n", input);
+    return;
+  }
+
+  move_gap(index);
+  text[gap_start++] = input;
+}
+
+
+void input_line_delete(int index) {
+  if (index >= input_line_get_length())
+    return;
+
+  move_gap(index);
+  gap_end++;
+}
+
+
+void input_line_screen_is_blank() {
+  int i;
+
+  for (i=0; i<shown_size; i++)
+    shown[i] = Z_UCS_SPACE;
+}
+
+
+void input_line_screen_shows_input(int scroll_x, int display_width) {
+  int i;
+
+  ensure_display_width(display_width);
+
+  for (i=0; i<display_width; i++)
+    shown[i] = get_cell(scroll_x + i);
+}
+
+
+void input_line_shift_screen(
+    struct z_screen_monospace_interface *screen_interface,
+    int y, int x, int first, int count, int dx) {
+
+  // Anything not copied here is still marked with its old contents and
+  // will be drawn again by "input_line_draw".
+  if ( (count <= 0) || (first < 0) || (first + dx < 0)
+      || (first + count > shown_size) || (first + dx + count > shown_size) )
+    return;
+
+  screen_interface->copy_area(y, x + first + dx, y, x + first, 1, count);
+  memmove(shown + first + dx, shown + first, sizeof(z_ucs) * count);
+}
+
+
+void input_line_draw(struct z_screen_monospace_interface *screen_interface,
+    int y, int x, int scroll_x, int display_width) {
+  int column = 0, run_start, run_end;
+  z_ucs cell;
+
+  ensure_display_width(display_width);
+
+  while (column < display_width) {
+    if (get_cell(scroll_x + column) == shown[column]) {
+      column++;
+      continue;
+    }
+
+    run_start = column;
+    run_end = column;
+    while ( (column < display_width)
+        && (column - run_end < INPUT_LINE_MAX_RESENT_CELLS) ) {
+      cell = get_cell(scroll_x + column);
+      if (cell != shown[column]) {
+        shown[column] = cell;
+        run_end = column + 1;
+      }
+      row[column - run_start] = cell;
+      column++;
+    }
+
+    screen_interface->goto_yx(y, x + run_start);
+    z_ucs_span_output(screen_interface, row, run_end - run_start);
+  }
+}
+
+
+size_t input_line_get_memory_size() {
+  return sizeof(z_ucs) * (text_size + 2 * shown_size);
+}
+
+
+void input_line_free() {
+  free(text);
+  text = NULL;
+  text_size = 0;
+  line_size = 0;
+  gap_start = 0;
+  gap_end = 0;
+
+  free(shown);
+  shown = NULL;
+  free(row);
+  row = NULL;
+  shown_size = 0;
+}
+
@@ -0,0 +1,78 @@
+/* input_line.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef input_line_h_INCLUDED
+#define input_line_h_INCLUDED
+
+#include "tools/types.h"
+#include "../screen_interface/screen_monospace_interface.h"
+
+// Keeps the text of the line currently being edited in a gap buffer, so
+// that inserting or deleting at the cursor doesn't move the rest of the
+// line, together with a copy of the cells the input line shows on-screen.
+// Drawing compares both and only sends the cells which actually changed.
+
+// The text of a line input, kept aside while the verification routine
+// reads another line.
+struct input_line_state
+{
+  z_ucs *text;
+  int length;
+  int maximum_length;
+};
+
+void input_line_reset(int maximum_length);
+void input_line_save(struct input_line_state *state);
+void input_line_restore(struct input_line_state *state);
+int input_line_get_length();
+z_ucs input_line_get_char(int index);
+void input_line_insert(int index, z_ucs input);
+void input_line_delete(int index);
+
+// Tell the input line what's on-screen after somebody else has drawn it.
+void input_line_screen_is_blank();
+void input_line_screen_shows_input(int scroll_x, int display_width);
+
+// Moves "count" cells starting at column "first" by "dx" columns using
+// "copy_area", columns are counted from zero at "x".
+void input_line_shift_screen(
+    struct z_screen_monospace_interface *screen_interface,
+    int y, int x, int first, int count, int dx);
+
+void input_line_draw(struct z_screen_monospace_interface *screen_interface,
+    int y, int x, int scroll_x, int display_width);
+size_t input_line_get_memory_size();
+void input_line_free();
+
+#endif /* input_line_h_INCLUDED */
+
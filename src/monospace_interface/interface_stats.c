@@ -0,0 +1,126 @@
+/* interface_stats.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "tools/types.h"
+#include "tools/z_ucs.h"
+
+#include "interface_stats.h"
+#include "z_ucs_span.h"
+
+
+struct monospace_interface_stats monospace_stats;
+
+static struct z_screen_monospace_interface *target = NULL;
+static struct z_screen_monospace_interface stats_interface;
+
+
+static void stats_goto_yx(int y, int x) {
+  monospace_stats.goto_yx_calls++;
+  target->goto_yx(y, x);
+}
+
+
+static void stats_z_ucs_output(z_ucs *output) {
+  monospace_stats.z_ucs_output_calls++;
+  monospace_stats.characters_output += z_ucs_len(output);
+  target->z_ucs_output(output);
+}
+
+
+static void stats_z_ucs_output_n(const z_ucs *output, size_t length) {
+  monospace_stats.z_ucs_output_calls++;
+  monospace_stats.characters_output += length;
+  z_ucs_span_output(target, output, length);
+}
+
+
+static void stats_set_text_style(z_style text_style) {
+  monospace_stats.set_text_style_calls++;
+  target->set_text_style(text_style);
+}
+
+
+static void stats_set_colour(z_colour foreground, z_colour background) {
+  monospace_stats.set_colour_calls++;
+  target->set_colour(foreground, background);
+}
+
+
+static void stats_copy_area(int dsty, int dstx, int srcy, int srcx,
+    int height, int width) {
+  monospace_stats.copy_area_calls++;
+  target->copy_area(dsty, dstx, srcy, srcx, height, width);
+}
+
+
+static void stats_clear_area(int startx, int starty, int xsize, int ysize) {
+  monospace_stats.clear_area_calls++;
+  target->clear_area(startx, starty, xsize, ysize);
+}
+
+
+static void stats_scroll_region(int top, int bottom, int lines) {
+  monospace_stats.scroll_region_calls++;
+  target->scroll_region(top, bottom, lines);
+}
+
+
+struct z_screen_monospace_interface *interface_stats_wrap_interface(
+    struct z_screen_monospace_interface *new_target) {
+  if (target != NULL)
+    return &stats_interface;
+
+  target = new_target;
+
+  stats_interface = *target;
+  stats_interface.goto_yx = &stats_goto_yx;
+  stats_interface.z_ucs_output = &stats_z_ucs_output;
+  stats_interface.z_ucs_output_n = &stats_z_ucs_output_n;
+  stats_interface.set_text_style = &stats_set_text_style;
+  stats_interface.set_colour = &stats_set_colour;
+  stats_interface.copy_area = &stats_copy_area;
+  stats_interface.clear_area = &stats_clear_area;
+  if (target->scroll_region != NULL)
+    stats_interface.scroll_region = &stats_scroll_region;
+
+  return &stats_interface;
+}
+
+
+struct z_screen_monospace_interface *interface_stats_unwrap_interface() {
+  struct z_screen_monospace_interface *result = target;
+
+  target = NULL;
+  return result;
+}
+
@@ -62,8 +62,9 @@
  * 2. When cshl exactly corresponds to the top line of the area of refresh,
  *    the cursor is placed in the top-left and output can be started right
  *    away. Output is limited to (y_size) lines. After paragraph output,
- *    refresh_window0 is executed recusively, resulting in another step 2
- *    execution.
+ *    the next refresh pass starts, resulting in another step 2 execution.
+ *    All passes are run in a loop, so stack use doesn't depend on the
+ *    number of paragraphs involved.
  *
  * 3. In case cshl is located somewhere inside the refresh area -- not on
  *    the topmost or lowermost line -- the history is rewinded by one
@@ -80,6 +81,7 @@
 #include <math.h>
 #include <stdint.h> // FOR INT32_MAX
 #include <errno.h>
+#include <time.h>
 
 #include "tools/i18n.h"
 #include "tools/tracelog.h"
@@ -97,10 +99,29 @@
 #include "interpreter/output.h"
 
 #include "monospace_interface.h"
+#include "draw_op_batch.h"
+#include "input_line.h"
+#include "interface_stats.h"
+#include "paragraph_cache.h"
+#include "scroll_batch.h"
+#include "scrollback_index.h"
+#include "shadow_grid.h"
+#include "trace_ring.h"
+#include "upper_window_cache.h"
+#include "z_ucs_scan.h"
+#include "z_ucs_span.h"
 #include "../screen_interface/screen_monospace_interface.h"
 #include "../locales/libmonospaceif_locales.h"
 #include "../locales/locale_data.h"
 
+// Resizes are applied once the backend hasn't reported another one for
+// this long.
+#define RESIZE_QUIET_PERIOD_MILLIS 100
+
+// A history output left behind by new output is moved forward over at most
+// this many paragraphs, beyond that setting up a new one is cheaper.
+#define MAX_HISTORY_ADVANCE_PARAGRAPHS 64
+
 
 struct z_window {
   // Attributes as defined by Z-Machine-Spec:
@@ -145,6 +166,38 @@ struct z_window {
   WORDWRAP *wordwrapper;
 };
 
+
+// Timed input runs against absolute deadlines on the monotonic clock, so
+// the backend is only woken up when the verification routine is due and
+// late wakeups don't add up over time.
+struct timed_input {
+  bool active;
+  int64_t interval_millis;
+  int64_t start_millis;
+  int64_t deadline_millis;
+};
+
+
+// State of a line input in progress. Everything "read_line" needs between
+// two events is kept here instead of on the C stack, so that the input can
+// be processed one event at a time by "process_line_input_event".
+struct line_input {
+  zscii *dest;
+  uint16_t maximum_length;
+  uint32_t verification_routine;
+  int *tenth_seconds_elapsed;
+  bool disable_command_history;
+  bool return_on_escape;
+  bool input_in_progress;
+  int input_size;
+  int input_scroll_x;
+  int input_index;
+  int input_display_width; // Width of the input line on-screen.
+  int input_x, input_y; // Leftmost position of the input line on-screen.
+  int cmd_history_index;
+  struct timed_input timed_input;
+};
+
 static char *screen_monospace_interface_version = LIBMONOSPACEINTERFACE_VERSION;
 static int screen_height = -1;
 static int screen_width = -1;
@@ -156,25 +209,48 @@ static bool hyphenation_enabled = true;
 static bool using_colors = false;
 static bool color_disabled = false;
 static bool disable_more_prompt = false;
+static bool shadow_grid_enabled = false;
+static bool shadow_grid_active = false;
+static bool draw_op_batch_active = false;
+static bool interface_stats_active = false;
+static bool scroll_batch_active = false;
 static z_ucs *libmonospaceif_more_prompt;
 static z_ucs *libmonospaceif_score_string;
 static z_ucs *libmonospaceif_turns_string;
-static z_ucs space_string[] = { Z_UCS_SPACE, 0 };
 static int libmonospaceif_right_status_min_size;
+static z_ucs *status_line = NULL;
+static z_ucs *new_status_line = NULL;
+static int status_line_width = 0;
+static bool status_line_valid = false;
+static z_ucs *last_status_room_description = NULL;
+static int last_status_room_description_size = 0;
+static int last_status_line_mode = -1;
+static int16_t last_status_parameter1;
+static int16_t last_status_parameter2;
 static int active_z_window_id = -1;
 static z_colour current_output_foreground_colour = -3;
 static z_colour current_output_background_colour = -3;
 static z_style current_output_text_style = -1;
 static int last_split_window_size = 0;
 static bool winch_found = false;
+static bool resize_pending = false;
+static int pending_screen_height = -1;
+static int pending_screen_width = -1;
 static bool interface_open = false;
 
-// The "history" is used by the scrolling and and screen-refresh
-// functions. It is allocated as long as scrolling is in
-// progress (means as long as the user only presses page-up or page-down
-// and no output occurs inbetween) and as long as the "refresh_window0"
-// method is active. Otherwise it must be null.
+// The "history" is used by the scrolling and screen-refresh functions to
+// replay window 0's output. Once allocated, it's kept and moved forward
+// over new output, so that paging and refreshing don't have to create it
+// again in every turn.
 static history_output *history = NULL;
+// True while the output passed to "z_ucs_output" is replayed from the
+// history, as opposed to new output from the story.
+static bool replaying_history = false;
+// True while the history output is moved forward over new paragraphs,
+// which are already on-screen and must not be drawn again.
+static bool advancing_history = false;
+static void *last_history_front = NULL;
+static unsigned long history_generation = 0;
 
 static int current_history_screen_line = -1;
 static bool current_history_hit_top = false;
@@ -183,16 +259,13 @@ static int rightmost_y_refresh_curpos = -1;
 // This flag is set to true when an read_line is currently underway. It's
 // used by screen refresh functions like "new_monospace_screen_size".
 static bool input_line_on_screen = false;
-static z_ucs *current_input_buffer = NULL;
 static z_ucs newline_string[] = { '\n', 0 };
 
-static bool timed_input_active;
 
 static struct z_window **z_windows;
 static struct z_screen_monospace_interface *screen_monospace_interface = NULL;
 
-static int *current_input_size, *current_input_scroll_x, *current_input_index;
-static int *current_input_display_width, *current_input_x, *current_input_y;
+static struct line_input *current_line_input = NULL;
 
 static char last_left_margin_config_value_as_string[MAX_MARGIN_AS_STRING_LEN];
 static char last_right_margin_config_value_as_string[MAX_MARGIN_AS_STRING_LEN];
@@ -203,6 +276,9 @@ static char *my_config_option_names[] = {
   "right-margin",
   "disable-hyphenation",
   "disable-color",
+  "enable-shadow-grid",
+  "enable-trace-ring",
+  "trace-ring-file",
   NULL };
 
 static char **config_option_names = my_config_option_names;
@@ -295,6 +371,35 @@ static void flush_all_buffered_windows() {
 }
 
 
+// Moves the contents of the rows "top" to "bottom" of the given window up
+// by "lines" rows, or down for negative values. Returns true in case the
+// backend's native scrolling was used, which has already cleared the rows
+// vacated. Otherwise these still have to be cleared by the caller.
+static bool scroll_window_rows(int window_id, int top, int bottom,
+    int lines) {
+  struct z_window *window = z_windows[window_id];
+  int height = bottom - top + 1;
+
+  if ( (screen_monospace_interface->scroll_region != NULL)
+      && (window->xpos == 1)
+      && (window->xsize == screen_width) ) {
+    screen_monospace_interface->scroll_region(top, bottom, lines);
+    return true;
+  }
+
+  if (lines > 0)
+    screen_monospace_interface->copy_area(
+        top, window->xpos, top + lines, window->xpos,
+        height - lines, window->xsize);
+  else
+    screen_monospace_interface->copy_area(
+        top - lines, window->xpos, top, window->xpos,
+        height + lines, window->xsize);
+
+  return false;
+}
+
+
 void clear_to_end_of_monospace_line() {
   z_style style_buf;
 
@@ -303,6 +408,9 @@ void clear_to_end_of_monospace_line() {
   z_windows[active_z_window_id]->output_text_style &= ~Z_STYLE_REVERSE_VIDEO;
   update_output_text_style(active_z_window_id);
 
+  if (active_z_window_id == 1)
+    upper_window_cache_mark_row_dirty(z_windows[1]->ycursorpos);
+
   screen_monospace_interface->clear_to_eol();
 
   // Re-enable potential reverse output.
@@ -314,13 +422,22 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
     void *window_number_as_void) {
   int window_number = *((int*)window_number_as_void);
   z_ucs input, event_type;
-  z_ucs buf = 0; // init to 0 to calm compiler.
-  z_ucs *linebreak;
+  z_ucs *linebreak, *line_end, *output_end, *next_newline = NULL;
   int space_on_line, i;
+  bool native_scroll;
 
   if (*z_ucs_output == 0)
     return;
 
+  // The end of the output and the next newline are only searched once,
+  // so that the loop below scans every char a single time.
+  output_end = z_ucs_scan_end(z_ucs_output);
+
+  TRACE_EVENT(TRACE_EVENT_WINDOW_OUTPUT,
+      window_number,
+      output_end - z_ucs_output,
+      z_windows[window_number]->ycursorpos);
+
   if (z_windows[window_number]->ycursorpos - 1
       + z_windows[window_number]->lowermargin
       >= z_windows[window_number]->ysize) {
@@ -338,7 +455,7 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
       z_windows[window_number]->xsize,
       z_windows[window_number]->ysize);
 
-  while (*z_ucs_output != 0) {
+  while (z_ucs_output < output_end) {
     TRACE_LOG("remaining_lines_to_fill: %d, lines to skip: %d.\n",
         z_windows[window_number]->remaining_lines_to_fill,
         z_windows[0]->lines_to_skip);
@@ -355,7 +472,9 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
 
     // Find a suitable spot to break the line. Check if data contains some
     // newline char.
-    linebreak = z_ucs_chr(z_ucs_output, Z_UCS_NEWLINE);
+    if ( (next_newline == NULL) || (next_newline < z_ucs_output) )
+      next_newline = z_ucs_scan_chr(z_ucs_output, output_end, Z_UCS_NEWLINE);
+    linebreak = next_newline < output_end ? next_newline : NULL;
 
     // In case we cannot put anymore on this line anyway, simple advance
     // to the next newline or finish output.
@@ -395,7 +514,7 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
       // we'll put as much on the line as possible and break after that.
 
       linebreak
-        = (signed)z_ucs_len(z_ucs_output) > space_on_line
+        = output_end - z_ucs_output > space_on_line
         ? z_ucs_output + space_on_line
         : NULL;
     }
@@ -404,27 +523,23 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
     // not work if margins are used and probably (untested) if a window
     // is not at the left side.
 
-    // In case we're breaking in the middle of the line, we'll have to
-    // put a '\0' there and store the original data in "buf".
-    if (linebreak != NULL) {
-      TRACE_LOG("linebreak found.\n");
-      buf = *linebreak;
-      *linebreak = 0;
-      TRACE_LOG("buf: %d\n", buf);
-    }
+    // The line is passed as a span, so the output is never modified.
+    line_end = linebreak != NULL ? linebreak : output_end;
 
-    TRACE_LOG("Output at %d/%d:\"",
+    TRACE_LOG("Output of %d chars at %d/%d.\n",
+        (int)(line_end - z_ucs_output),
         z_windows[window_number]->xcursorpos,
         z_windows[window_number]->ycursorpos);
     refresh_cursor(window_number);
-    TRACE_LOG_Z_UCS(z_ucs_output);
-    TRACE_LOG("\".\n");
 
     // Output data as far space on the line permits.
     if ( (z_windows[window_number]->lines_to_skip < 1)
         && (z_windows[window_number]->remaining_lines_to_fill != 0) ) {
-      screen_monospace_interface->z_ucs_output(z_ucs_output);
-      z_windows[window_number]->xcursorpos += z_ucs_len(z_ucs_output);
+      z_ucs_span_output(screen_monospace_interface,
+          z_ucs_output, line_end - z_ucs_output);
+      z_windows[window_number]->xcursorpos += line_end - z_ucs_output;
+      if (window_number == 1)
+        upper_window_cache_mark_row_dirty(z_windows[1]->ycursorpos);
     }
 
     if (linebreak != NULL) {
@@ -446,23 +561,21 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
             && (z_windows[window_number]->wrapping == true) ) {
           // Due to the if clause regarding wrapping above, at this point we
           // now we're allowed to scroll at the bottom of the window.
-          TRACE_LOG("copy_area with upper margin %d, lower margin: %d.\n",
+          TRACE_LOG("Scrolling with upper margin %d, lower margin: %d.\n",
               z_windows[0]->uppermargin, z_windows[0]->lowermargin);
-          screen_monospace_interface->copy_area(
+          native_scroll = scroll_window_rows(
+              window_number,
               z_windows[window_number]->ypos
               + z_windows[window_number]->uppermargin,
-              z_windows[window_number]->xpos,
               z_windows[window_number]->ypos
-              + z_windows[window_number]->uppermargin + 1,
-              z_windows[window_number]->xpos,
-              z_windows[window_number]->ysize
+              + z_windows[window_number]->ysize
               - z_windows[window_number]->lowermargin
-              - z_windows[window_number]->uppermargin
               - 1,
-              z_windows[window_number]->xsize);
+              1);
           refresh_cursor(window_number);
           // Clear line, including left margin, to EOL.
-          clear_to_end_of_monospace_line();
+          if (native_scroll == false)
+            clear_to_end_of_monospace_line();
         }
         else {
           // If we're not at the bottom of the window, simply move
@@ -483,9 +596,7 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
           = 1 + z_windows[window_number]->leftmargin;
       }
 
-      // Restore char at linebreak and additionally skip newline if
-      // required.
-      *linebreak = buf;
+      // Continue at linebreak and additionally skip newline if required.
       z_ucs_output = linebreak;
       if (*z_ucs_output == Z_UCS_NEWLINE) {
         TRACE_LOG("newline-skip.\n");
@@ -503,6 +614,19 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
               == z_windows[window_number]->ysize - 1)
             && (disable_more_prompt == false)
             && (winch_found == false)
+            && (resize_pending == true)
+            && (z_windows[window_number]->remaining_lines_to_fill != 0)
+            && (z_windows[window_number]->lines_to_skip < 1) ) {
+          // A more prompt would be placed according to the old screen
+          // size. Redrawing isn't possible from within the word wrapper, so
+          // the resize is applied once "z_ucs_output" has returned from it.
+          TRACE_LOG("Resize pending at more prompt.\n");
+          winch_found = true;
+        }
+        else if ( (z_windows[window_number]->nof_consecutive_lines_output
+              == z_windows[window_number]->ysize - 1)
+            && (disable_more_prompt == false)
+            && (winch_found == false)
             && (z_windows[window_number]->remaining_lines_to_fill != 0)
             && (z_windows[window_number]->lines_to_skip < 1) ) {
 
@@ -517,6 +641,8 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
             }
           }
 
+          monospace_stats.more_prompts++;
+          TRACE_EVENT(TRACE_EVENT_MORE_PROMPT, window_number, 0, 0);
           screen_monospace_interface->z_ucs_output(libmonospaceif_more_prompt);
           screen_monospace_interface->update_screen();
           refresh_cursor(window_number);
@@ -538,6 +664,9 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
 
           if (event_type == EVENT_WAS_WINCH) {
             winch_found = true;
+            new_monospace_screen_size(
+                screen_monospace_interface->get_screen_height(),
+                screen_monospace_interface->get_screen_width());
             // The more prompt was "interrupted" by a window screen size
             // change. We'll now have to initiate a redraw. Since a redraw
             // is always based on the history, which is not synced to the
@@ -558,7 +687,7 @@ void z_ucs_output_window_target(z_ucs *z_ucs_output,
         z_windows[window_number]->remaining_lines_to_fill--;
     }
     else
-      z_ucs_output += z_ucs_len(z_ucs_output);
+      z_ucs_output = output_end;
   }
 
   TRACE_LOG("z_ucs_output_window_target finished.\n");
@@ -735,6 +864,34 @@ static int parse_config_parameter(char *key, char *value) {
     free(value);
     return 0;
   }
+  else if (strcasecmp(key, "enable-shadow-grid") == 0) {
+    if ( (value == NULL)
+        || (*value == 0)
+        || (strcmp(value, config_true_value) == 0) )
+      shadow_grid_enabled = true;
+    else
+      shadow_grid_enabled = false;
+    free(value);
+    return 0;
+  }
+  else if (strcasecmp(key, "enable-trace-ring") == 0) {
+    if ( (value == NULL)
+        || (*value == 0)
+        || (strcmp(value, config_true_value) == 0) )
+      trace_ring_enable(true);
+    else
+      trace_ring_enable(false);
+    free(value);
+    return 0;
+  }
+  else if (strcasecmp(key, "trace-ring-file") == 0) {
+    if ( (value == NULL) || (strlen(value) == 0) ) {
+      free(value);
+      return -1;
+    }
+    trace_ring_set_dump_filename(value);
+    return 0;
+  }
   else {
     return screen_monospace_interface->parse_config_parameter(key, value);
   }
@@ -773,6 +930,22 @@ static char *get_config_value(char *key)
       ? config_true_value
       : config_false_value;
   }
+  else if (strcasecmp(key, "enable-shadow-grid") == 0)
+  {
+    return shadow_grid_enabled == true
+      ? config_true_value
+      : config_false_value;
+  }
+  else if (strcasecmp(key, "enable-trace-ring") == 0)
+  {
+    return trace_ring_enabled == true
+      ? config_true_value
+      : config_false_value;
+  }
+  else if (strcasecmp(key, "trace-ring-file") == 0)
+  {
+    return trace_ring_get_dump_filename();
+  }
   else
   {
     return screen_monospace_interface->get_config_value(key);
@@ -786,8 +959,15 @@ static char **get_config_option_names()
 }
 
 
+static void discard_output_history();
+static void apply_pending_resize();
+
+
 static void z_ucs_output(z_ucs *z_ucs_output)
 {
+  if (advancing_history == true)
+    return;
+
   TRACE_LOG("Output: \"");
   TRACE_LOG_Z_UCS(z_ucs_output);
   TRACE_LOG("\" to window %d, buffering: %d.\n",
@@ -813,17 +993,83 @@ static void z_ucs_output(z_ucs *z_ucs_output)
         z_windows[active_z_window_id]->wordwrapper, z_ucs_output);
     }
   }
+
+  // A resize which interrupted the output at a more prompt is drawn now,
+  // the rest of the output is placed according to the new size.
+  if ( (winch_found == true)
+      && (resize_pending == true)
+      && (replaying_history == false) ) {
+    flush_all_buffered_windows();
+    apply_pending_resize();
+  }
+
   TRACE_LOG("z_ucs_output finished.\n");
 }
 
 
+// Puts the optional layers between the library and the backend, they are
+// removed again by "detach_interface_layers" when the story is closed.
+static void attach_interface_layers()
+{
+  // Backends accepting batched draw operations get all output in a single
+  // call per screen update.
+  if (screen_monospace_interface->draw_ops != NULL) {
+    screen_monospace_interface = draw_op_batch_wrap_interface(
+        screen_monospace_interface);
+    draw_op_batch_active = true;
+  }
+
+  screen_monospace_interface = interface_stats_wrap_interface(
+      screen_monospace_interface);
+  interface_stats_active = true;
+
+  // Scrolling through long output results in one copy per line, these are
+  // combined into a single copy per screen update.
+  screen_monospace_interface = scroll_batch_wrap_interface(
+      screen_monospace_interface);
+  scroll_batch_active = true;
+
+  if (shadow_grid_enabled == true) {
+    screen_monospace_interface = shadow_grid_wrap_interface(
+        screen_monospace_interface, screen_height, screen_width);
+    shadow_grid_active = true;
+  }
+}
+
+
+static void detach_interface_layers()
+{
+  if (shadow_grid_active == true) {
+    screen_monospace_interface = shadow_grid_unwrap_interface();
+    shadow_grid_active = false;
+  }
+
+  if (scroll_batch_active == true) {
+    screen_monospace_interface = scroll_batch_unwrap_interface();
+    scroll_batch_active = false;
+  }
+
+  if (interface_stats_active == true) {
+    screen_monospace_interface = interface_stats_unwrap_interface();
+    interface_stats_active = false;
+  }
+
+  if (draw_op_batch_active == true) {
+    screen_monospace_interface = draw_op_batch_unwrap_interface();
+    draw_op_batch_active = false;
+  }
+}
+
+
 static void link_interface_to_story(struct z_story *story)
 {
   int bytes_to_allocate;
+  struct z_window *windows;
   int len;
   int i;
 
   TRACE_LOG("Linking screen interface to monospace interface.\n");
+  resize_pending = false;
   screen_monospace_interface->link_interface_to_story(story);
   TRACE_LOG("Linking complete.\n");
 
@@ -848,6 +1094,8 @@ static void link_interface_to_story(struct z_story *story)
   screen_height = screen_monospace_interface->get_screen_height();
   screen_width = screen_monospace_interface->get_screen_width();
 
+  attach_interface_layers();
+
   if (ver <= 2)
     nof_active_z_windows = 1;
   else if (ver == 6)
@@ -863,15 +1111,19 @@ static void link_interface_to_story(struct z_story *story)
 
   TRACE_LOG("Number of active windows: %d.\n", nof_active_z_windows);
 
-  bytes_to_allocate = sizeof(struct z_window*) * nof_active_z_windows;
+  // The pointer array is followed by the windows themselves in the same
+  // block, so all windows are allocated and freed at once. Since a window
+  // contains a pointer, the array's size keeps the windows aligned.
+  bytes_to_allocate
+    = (sizeof(struct z_window*) + sizeof(struct z_window))
+    * nof_active_z_windows;
 
   z_windows = (struct z_window**)fizmo_malloc(bytes_to_allocate);
-
-  bytes_to_allocate = sizeof(struct z_window);
+  windows = (struct z_window*)(z_windows + nof_active_z_windows);
 
   for (i=0; i<nof_active_z_windows; i++)
   {
-    z_windows[i] = (struct z_window*)fizmo_malloc(bytes_to_allocate);
+    z_windows[i] = &windows[i];
     z_windows[i]->window_number = i;
     z_windows[i]->ypos = 1;
     z_windows[i]->xpos = 1;
@@ -1002,6 +1254,13 @@ static void link_interface_to_story(struct z_story *story)
 
   refresh_cursor(active_z_window_id);
 
+  status_line_valid = false;
+
+  // The ring only keeps this story's events. From now on, an exit means
+  // that something went wrong.
+  trace_ring_clear();
+  trace_ring_set_dump_on_exit(true);
+
   /*
   // Advance the cursor for ZTUU. This will allow the player to read
   // the first line of text before it's overwritten by the status line.
@@ -1054,27 +1313,43 @@ static int monospace_close_interface(z_ucs *error_message)
   }
 
   screen_monospace_interface->close_interface(error_message);
+  trace_ring_set_dump_on_exit(false);
+  resize_pending = false;
+
+  detach_interface_layers();
+
+  discard_output_history();
+  paragraph_cache_free();
+  scrollback_index_free();
+  upper_window_cache_free();
+  input_line_free();
+
+  free(status_line);
+  free(new_status_line);
+  free(last_status_room_description);
+  status_line = NULL;
+  new_status_line = NULL;
+  last_status_room_description = NULL;
+  status_line_width = 0;
+  last_status_room_description_size = 0;
+  status_line_valid = false;
 
   free(libmonospaceif_more_prompt);
   free(libmonospaceif_score_string);
   free(libmonospaceif_turns_string);
 
-  for (i=0; i<nof_active_z_windows; i++)
+  if (z_windows != NULL)
   {
-    if (z_windows[i]->wordwrapper != NULL)
+    for (i=0; i<nof_active_z_windows; i++)
     {
-      if (z_windows[i] != NULL)
+      if (z_windows[i]->wordwrapper != NULL)
       {
         wordwrap_destroy_wrapper(z_windows[i]->wordwrapper);
         z_windows[i]->wordwrapper = NULL;
-        free(z_windows[i]);
-        z_windows[i] = NULL;
       }
     }
-  }
 
-  if (z_windows != NULL)
-  {
+    // Frees the windows as well, see "link_interface_to_story".
     free(z_windows);
     z_windows = NULL;
   }
@@ -1117,6 +1392,7 @@ static void split_window(int16_t nof_lines)
       z_windows[0]->ypos += lines_delta;
       z_windows[1]->ysize += lines_delta;
       z_windows[1]->scrollback_top_line += lines_delta;
+      upper_window_cache_invalidate();
 
       if (z_windows[0]->ycursorpos < 1)
       {
@@ -1185,6 +1461,9 @@ static void erase_window(int16_t window_number)
     // Re-enable potential reverse output.
     z_windows[window_number]->output_text_style = style_buf;
 
+    if (window_number == 1)
+      upper_window_cache_invalidate();
+
     z_windows[window_number]->xcursorpos
       = 1 + z_windows[window_number]->leftmargin;
     z_windows[window_number]->ycursorpos
@@ -1199,6 +1478,9 @@ static void set_text_style(z_style text_style)
 {
   int i;
 
+  if (advancing_history == true)
+    return;
+
   TRACE_LOG("New text style is %d.\n", text_style);
   //z_windows[active_z_window_id]->text_style = text_style;
 
@@ -1223,6 +1505,9 @@ static void set_colour(z_colour foreground, z_colour background,
 {
   int index, end_index, highest_valid_window_id;
 
+  if (advancing_history == true)
+    return;
+
   TRACE_LOG("set-color: %d,%d,%d\n", foreground, background, window_number);
 
   if (using_colors != true)
@@ -1294,9 +1579,24 @@ static history_output_target history_target =
 };
 
 
+// Sends the cells of the input line which differ from the screen.
+static void draw_line_input(struct line_input *line) {
+  input_line_draw(screen_monospace_interface,
+      line->input_y, line->input_x,
+      line->input_scroll_x, line->input_display_width);
+}
+
+
+static void shift_line_input(struct line_input *line,
+    int first, int count, int dx) {
+  input_line_shift_screen(screen_monospace_interface,
+      line->input_y, line->input_x, first, count, dx);
+}
+
+
 static void refresh_input_line()
 {
-  z_ucs buf = 0;
+  struct line_input *line = current_line_input;
   int last_active_z_window_id = -1;
 
   TRACE_LOG("Refreshing input line.\n");
@@ -1310,43 +1610,29 @@ static void refresh_input_line()
     switch_to_window(0);
   }
 
-  if (*current_input_size > 0) {
+  if (line->input_size > 0) {
     TRACE_LOG("out:%d, %d, %d\n",
-        *current_input_size, *current_input_scroll_x,
-        *current_input_display_width);
+        line->input_size, line->input_scroll_x, line->input_display_width);
 
     // Set output style to current window 0 style.
     update_output_colours(0);
     update_output_text_style(0);
 
-    TRACE_LOG("Current input size: %d.\n", *current_input_size);
-
-    if (*current_input_size - *current_input_scroll_x
-        >= *current_input_display_width + 1)
-    {
-      buf = current_input_buffer[
-        *current_input_scroll_x + *current_input_display_width];
-      current_input_buffer[
-        *current_input_scroll_x + *current_input_display_width] = 0;
-    }
+    TRACE_LOG("Current input size: %d.\n", line->input_size);
 
-    screen_monospace_interface->goto_yx(*current_input_y, *current_input_x);
-    screen_monospace_interface->z_ucs_output(
-        current_input_buffer + *current_input_scroll_x);
-    if (buf != 0)
-      current_input_buffer[
-        *current_input_scroll_x + *current_input_display_width] = buf;
+    // The input line has just been cleared by whoever called us.
+    input_line_screen_is_blank();
+    draw_line_input(line);
   }
 
-  TRACE_LOG("cii: %d, cis: %d\n",
-      *current_input_index, *current_input_scroll_x);
+  TRACE_LOG("cii: %d, cis: %d\n", line->input_index, line->input_scroll_x);
   z_windows[0]->xcursorpos
-    = *current_input_x + *current_input_index - *current_input_scroll_x;
-  TRACE_LOG("ycp:%d, ciy: %d.\n", z_windows[0]->ycursorpos, *current_input_y);
+    = line->input_x + line->input_index - line->input_scroll_x;
+  TRACE_LOG("ycp:%d, ciy: %d.\n", z_windows[0]->ycursorpos, line->input_y);
   z_windows[0]->ycursorpos
-    = *current_input_y - (z_windows[0]->ypos - 1);
+    = line->input_y - (z_windows[0]->ypos - 1);
   wordwrap_set_line_index(z_windows[0]->wordwrapper,
-      *current_input_x - z_windows[0]->xpos - z_windows[0]->leftmargin);
+      line->input_x - z_windows[0]->xpos - z_windows[0]->leftmargin);
 
   refresh_cursor(active_z_window_id);
 
@@ -1357,23 +1643,29 @@ static void refresh_input_line()
 
 // This function returns true if at least one line of the desired output
 // could be displayed. It returns false in case nothing could be shown (which
-// means that the desired area-to-show is outside the recorded history).
+// means that the desired area-to-show is outside the recorded history or
+// that the area doesn't fit into the window).
 //
-// If nof_paragraph_diff is non-NULL, this function will modify it by the
-// number of paragraph history advances. That means that if one paragraph
-// has been repeated and the history pointer advanced accordingly, 1 is
-// added to the value references by this pointer. In case the history has been
-// rewinded by one last paragraph, 1 is being subtracted.
-static bool refresh_window0_inner(int y_size, int y_refresh_top,
-    int *nof_paragraph_diff) {
+// The cases described at the top of this file are evaluated in a loop: Each
+// pass either moves the history position towards the refresh area (case
+// #0), draws paragraphs and shrinks the area left to refresh (cases #1 and
+// #2) or finishes the refresh (case #3). The stack use is thus constant, and
+// the work done is bounded by the number of paragraphs passed plus the
+// number of lines drawn.
+static int get_window0_line_width();
+
+static bool refresh_window0_inner(int y_size, int y_refresh_top) {
   int return_code, lines_left, nof_paragraph_lines;
   int nof_relevant_lines, original_pos;
-  int my_paragraph_diff = 0;
+  int paragraph, target_paragraph, nof_repeated_paragraphs;
+  void *paragraph_end;
   bool result = false;
-  //z_ucs input;
+  bool refresh_done = false;
 
   TRACE_LOG("refresh_window0_inner(y_size:%d, y_refresh_top:%d)\n",
       y_size, y_refresh_top);
+  TRACE_EVENT(TRACE_EVENT_REFRESH_START,
+      y_size, y_refresh_top, z_windows[0]->scrollback_top_line);
   TRACE_LOG("lowermargin %d, uppermargin %d.\n",
       z_windows[0]->lowermargin, z_windows[0]->uppermargin);
 
@@ -1386,407 +1678,543 @@ static bool refresh_window0_inner(int y_size, int y_refresh_top,
   
   if (y_refresh_top > z_windows[0]->ysize) {
     TRACE_LOG("Cannot refresh below screen at line %d.\n", y_refresh_top);
-    exit(-1);
+    return false;
   }
   else if (y_refresh_top < 1) {
     TRACE_LOG("Cannot refresh above screen at line %d.\n", y_refresh_top);
-    exit(-1);
+    return false;
   }
 
   if (y_refresh_top - 1 + y_size > z_windows[0]->ysize) {
     TRACE_LOG("Cannot refresh area longer than screen at %d lines.\n",
         z_windows[0]->ysize);
-    exit(-1);
-    //y_size = z_windows[0]->ysize - y_refresh_top;
+    return false;
   }
 
-  TRACE_LOG("current_history_screen_line: %d, scrollback_top_line: %d\n",
-      current_history_screen_line,
-      z_windows[0]->scrollback_top_line);
+  while (refresh_done == false) {
+    TRACE_LOG("current_history_screen_line: %d, scrollback_top_line: %d\n",
+        current_history_screen_line,
+        z_windows[0]->scrollback_top_line);
 
-  TRACE_LOG("Refreshing screen from %d to %d at scrollback %d/%d.\n",
-      y_refresh_top,
-      y_refresh_top + (y_size - 1),
-      z_windows[0]->scrollback_top_line - (y_refresh_top - 1),
-      z_windows[0]->scrollback_top_line - ((y_refresh_top - 1) + (y_size - 1)));
-
-  // Please note:
-  // In the very first iteration, current_history_screen_line == 0 which means
-  // below the screen.
-
-  if (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
-      > current_history_screen_line) {
-    // 0. chsl lower than refresh-area boundary. this is a not-so-nice
-    //    case, since we don't know how many lines the next "upwards"
-    //    paragraph has, so we have to measure first -- we'll set
-    //    lines to skip to pseudo-infinite and proceed with case 1 or 2
-    //    afterwards.
-
-    TRACE_LOG("Scrolling case #0.\n");
-
-    return_code = output_rewind_paragraph(history, NULL, NULL, NULL);
-
-    if (return_code < 0) {
-      i18n_translate_and_exit(
-          libmonospaceif_module_name,
-          i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
-          -0x0100,
-          "output_rewind_paragraph");
-    }
-    else if (return_code == 1) {
-      // In case we've hit the buffer back there's nothing more to do since
-      // we're below the area to redraw.
-      current_history_hit_top = true;
-      result = false;
+    TRACE_LOG("Refreshing screen from %d to %d at scrollback %d/%d.\n",
+        y_refresh_top,
+        y_refresh_top + (y_size - 1),
+        z_windows[0]->scrollback_top_line - (y_refresh_top - 1),
+        z_windows[0]->scrollback_top_line
+        - ((y_refresh_top - 1) + (y_size - 1)));
+
+    // Please note:
+    // In the very first pass, current_history_screen_line == 0 which means
+    // below the screen.
+
+    if (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
+        > current_history_screen_line) {
+      // 0. chsl lower than refresh-area boundary. this is a not-so-nice
+      //    case, since we don't know how many lines the next "upwards"
+      //    paragraph has, so we have to measure first -- we'll set
+      //    lines to skip to pseudo-infinite and proceed with case 1 or 2
+      //    in one of the next passes.
+
+      TRACE_LOG("Scrolling case #0.\n");
+      TRACE_EVENT(TRACE_EVENT_REFRESH_CASE,
+          0, y_size, current_history_screen_line);
+
+      // Paragraphs which have already been measured at this width don't have
+      // to be looked at again, so we can rewind straight to the last known
+      // paragraph which is still below the refresh area's lower boundary.
+      paragraph = scrollback_index_get_paragraph(current_history_screen_line);
+      target_paragraph = scrollback_index_find_line(
+          z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size);
+      if (target_paragraph < 0)
+        target_paragraph = scrollback_index_get_size() - 1;
+
+      if ( (paragraph >= 0) && (target_paragraph >= paragraph) ) {
+        TRACE_LOG("Rewinding indexed paragraphs %d to %d.\n",
+            paragraph, target_paragraph);
+
+        while (paragraph <= target_paragraph) {
+          if (output_rewind_paragraph(history, NULL, NULL, NULL) != 0) {
+            TRACE_LOG("history inconsistent, indexed paragraph %d missing.\n",
+                paragraph);
+            i18n_translate_and_exit(
+                libmonospaceif_module_name,
+                i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+                -0x0100,
+                "output_rewind_paragraph");
+          }
+          paragraph++;
+        }
+
+        current_history_screen_line
+          = scrollback_index_get_top_line(target_paragraph);
+        z_windows[0]->lines_to_skip = 0;
+      }
+      else {
+        paragraph_end = (void*)history->current_paragraph_index;
+        return_code = output_rewind_paragraph(history, NULL, NULL, NULL);
+
+        if (return_code < 0) {
+          i18n_translate_and_exit(
+              libmonospaceif_module_name,
+              i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+              -0x0100,
+              "output_rewind_paragraph");
+        }
+        else if (return_code == 1) {
+          // In case we've hit the buffer back there's nothing more to do since
+          // we're below the area to redraw.
+          current_history_hit_top = true;
+          refresh_done = true;
+        }
+        else {
+          // Measuring a paragraph means wrapping all of it, so the result is
+          // kept for the next time the same paragraph is passed at the same
+          // line width.
+          nof_paragraph_lines = paragraph_cache_lookup(
+              (void*)history->current_paragraph_index,
+              paragraph_end,
+              get_window0_line_width(),
+              history_generation);
+
+          if (nof_paragraph_lines < 0) {
+            z_windows[0]->lines_to_skip = INT32_MAX;
+            z_windows[0]->nof_consecutive_lines_output = 0;
+            wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
+            z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
+            // No need to set ypos since we're not writing to screen anyway. All
+            // the other positions are required for proper linebreaking, though.
+            return_code = output_repeat_paragraphs(history, 1, true, false);
+            monospace_stats.paragraphs_replayed++;
+            if (bool_equal(z_windows[0]->buffering, true))
+              wordwrap_flush_output(z_windows[0]->wordwrapper);
+            nof_paragraph_lines
+              = z_windows[0]->nof_consecutive_lines_output + 1;
+            if ( (return_code < 0) && (current_history_screen_line != 0) ) {
+              TRACE_LOG("history inconsistent, buffer end at chsl: %d.\n",
+                  current_history_screen_line);
+              i18n_translate_and_exit(
+                  libmonospaceif_module_name,
+                  i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+                  -0x0100,
+                  "output_rewind_paragraph");
+            }
+            paragraph_cache_store(
+                (void*)history->current_paragraph_index,
+                paragraph_end,
+                get_window0_line_width(),
+                history_generation,
+                nof_paragraph_lines);
+          }
+
+          current_history_screen_line += nof_paragraph_lines;
+          if (scrollback_index_get_size() == paragraph)
+            scrollback_index_append(current_history_screen_line);
+          z_windows[0]->lines_to_skip = 0;
+        }
+      }
     }
-    else {
-      my_paragraph_diff--;
-      z_windows[0]->lines_to_skip = INT32_MAX;
+    else if (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
+        == current_history_screen_line) {
+      // 1. chsl exactly on lower refresh-area boundary.
+      TRACE_LOG("Scrolling case #1.\n");
+      TRACE_EVENT(TRACE_EVENT_REFRESH_CASE,
+          1, y_size, current_history_screen_line);
+
+      z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
+      z_windows[0]->ycursorpos = y_refresh_top + y_size - 1;
+      z_windows[0]->lowermargin
+        = z_windows[0]->ysize - (y_refresh_top + (y_size - 1));
       z_windows[0]->nof_consecutive_lines_output = 0;
       wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
-      z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
-      // No need to set ypos since we're not writing to screen anyway. All
-      // the other positions are required for proper linebreaking, though.
-      return_code = output_repeat_paragraphs(history, 1, true, false);
-      if (bool_equal(z_windows[0]->buffering, true))
-        wordwrap_flush_output(z_windows[0]->wordwrapper);
-      nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
-      if ( (return_code < 0) && (current_history_screen_line != 0) ) {
-        TRACE_LOG("history inconsistent, buffer end at chsl: %d.\n",
-            current_history_screen_line);
+      refresh_cursor(0);
+
+      TRACE_LOG("Refreshing above history line %d with lowermargin %d.\n",
+          current_history_screen_line, z_windows[0]->lowermargin);
+
+      if ((return_code = output_rewind_paragraph(history,NULL,NULL,NULL)) < 0) {
         i18n_translate_and_exit(
             libmonospaceif_module_name,
             i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
             -0x0100,
             "output_rewind_paragraph");
       }
-      current_history_screen_line += nof_paragraph_lines;
-      z_windows[0]->lines_to_skip = 0;
-      result = refresh_window0_inner(y_size, y_refresh_top, &my_paragraph_diff);
-    }
-  }
-  else if (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
-      == current_history_screen_line) {
-    // 1. chsl exactly on lower refresh-area boundary.
-    TRACE_LOG("Scrolling case #1.\n");
-
-    z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
-    z_windows[0]->ycursorpos = y_refresh_top + y_size - 1;
-    z_windows[0]->lowermargin
-      = z_windows[0]->ysize - (y_refresh_top + (y_size - 1));
-    z_windows[0]->nof_consecutive_lines_output = 0;
-    wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
-    refresh_cursor(0);
-
-    TRACE_LOG("Refreshing above history line %d with lowermargin %d.\n",
-        current_history_screen_line, z_windows[0]->lowermargin);
-
-    if ((return_code = output_rewind_paragraph(history,NULL,NULL,NULL)) < 0) {
-      i18n_translate_and_exit(
-          libmonospaceif_module_name,
-          i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
-          -0x0100,
-          "output_rewind_paragraph");
-    }
-    else if (return_code == 1) {
-      // In case we've hit the buffer back there's nothing more to do since
-      // we're at the bottom of the area to redraw.
-      current_history_hit_top = true;
-      result = false;
-    }
-    else {
-      z_windows[0]->uppermargin = y_refresh_top - 1;
-      if ( (output_repeat_paragraphs(history, 1, true, false) == -1)
-          && (current_history_screen_line != 0) ) {
-        TRACE_LOG("Buffer end, case #1, current_history_screen_line: %d.\n",
-            current_history_screen_line);
-        i18n_translate_and_exit(
-            libmonospaceif_module_name,
-            i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
-            -0x0100,
-            "output_repeat_paragraphs");
-      }
-      result = true;
-      TRACE_LOG("rewound_paragraph_was_newline_terminated: %d.\n",
-          history->rewound_paragraph_was_newline_terminated);
-      // This is a special case: When we're just starting rebuilding the
-      // screen from the bottom of the buffer -- which means that
-      // current_history_screen_line == 0 -- and the last paragraph was
-      // terminated with a newline, we have to send this one explicitly
-      // to the screen.
-      if ( (current_history_screen_line == 0)
-          && (history->rewound_paragraph_was_newline_terminated == true) ) {
-        z_ucs_output_window_target(
-            newline_string,
-            (void*)(&z_windows[0]->window_number));
+      else if (return_code == 1) {
+        // In case we've hit the buffer back there's nothing more to do since
+        // we're at the bottom of the area to redraw.
+        current_history_hit_top = true;
+        refresh_done = true;
       }
-      my_paragraph_diff--;
-      if (bool_equal(z_windows[0]->buffering, true))
-        wordwrap_flush_output(z_windows[0]->wordwrapper);
-      //screen_monospace_interface->update_screen();
-      //screen_monospace_interface->get_next_event(&input, -1);
-
-      z_windows[0]->uppermargin = 0;
-
-      if (current_history_screen_line == 0) {
-        rightmost_y_refresh_curpos
-          = z_windows[0]->xpos + z_windows[0]->xcursorpos - 1;
+      else {
+        z_windows[0]->uppermargin = y_refresh_top - 1;
+        monospace_stats.paragraphs_replayed++;
+        if ( (output_repeat_paragraphs(history, 1, true, false) == -1)
+            && (current_history_screen_line != 0) ) {
+          TRACE_LOG("Buffer end, case #1, current_history_screen_line: %d.\n",
+              current_history_screen_line);
+          i18n_translate_and_exit(
+              libmonospaceif_module_name,
+              i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+              -0x0100,
+              "output_repeat_paragraphs");
+        }
+        result = true;
+        TRACE_LOG("rewound_paragraph_was_newline_terminated: %d.\n",
+            history->rewound_paragraph_was_newline_terminated);
+        // This is a special case: When we're just starting rebuilding the
+        // screen from the bottom of the buffer -- which means that
+        // current_history_screen_line == 0 -- and the last paragraph was
+        // terminated with a newline, we have to send this one explicitly
+        // to the screen.
+        if ( (current_history_screen_line == 0)
+            && (history->rewound_paragraph_was_newline_terminated == true) ) {
+          z_ucs_output_window_target(
+              newline_string,
+              (void*)(&z_windows[0]->window_number));
+        }
+        if (bool_equal(z_windows[0]->buffering, true))
+          wordwrap_flush_output(z_windows[0]->wordwrapper);
+        //screen_monospace_interface->update_screen();
+        //screen_monospace_interface->get_next_event(&input, -1);
 
-        if (input_line_on_screen == true) {
-          TRACE_LOG("At end of history, storing input-pos at: %d, width: %d.\n",
-              z_windows[0]->xpos + z_windows[0]->xcursorpos
-              + z_windows[0]->rightmargin,
-              z_windows[0]->xsize - 1);
+        z_windows[0]->uppermargin = 0;
 
-          *current_input_y
-            = z_windows[0]->ypos + z_windows[0]->ycursorpos - 1;
-          *current_input_x
+        if (current_history_screen_line == 0) {
+          rightmost_y_refresh_curpos
             = z_windows[0]->xpos + z_windows[0]->xcursorpos - 1;
-          *current_input_display_width
-            = z_windows[0]->xpos + z_windows[0]->xsize - *current_input_x
-            - z_windows[0]->rightmargin;
-
-          TRACE_LOG("refresh-x: %d, refresh-y: %d.\n",
-              *current_input_x, *current_input_y);
-          TRACE_LOG("new input width: %d.\n",
-              *current_input_display_width);
+
+          if (input_line_on_screen == true) {
+            TRACE_LOG(
+                "At end of history, storing input-pos at: %d, width: %d.\n",
+                z_windows[0]->xpos + z_windows[0]->xcursorpos
+                + z_windows[0]->rightmargin,
+                z_windows[0]->xsize - 1);
+
+            current_line_input->input_y
+              = z_windows[0]->ypos + z_windows[0]->ycursorpos - 1;
+            current_line_input->input_x
+              = z_windows[0]->xpos + z_windows[0]->xcursorpos - 1;
+            current_line_input->input_display_width
+              = z_windows[0]->xpos + z_windows[0]->xsize
+              - current_line_input->input_x - z_windows[0]->rightmargin;
+
+            TRACE_LOG("refresh-x: %d, refresh-y: %d.\n",
+                current_line_input->input_x, current_line_input->input_y);
+            TRACE_LOG("new input width: %d.\n",
+                current_line_input->input_display_width);
+          }
         }
-      }
 
-      nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
-      current_history_screen_line += nof_paragraph_lines;
+        nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
+        current_history_screen_line += nof_paragraph_lines;
 
-      TRACE_LOG("Number of lines in last paragraph: %d.\n",
-          nof_paragraph_lines);
+        TRACE_LOG("Number of lines in last paragraph: %d.\n",
+            nof_paragraph_lines);
 
-      // We'll now determine whether some of the output is actually
-      // relevant to our redraw operation.
-      nof_relevant_lines
-        = current_history_screen_line
-        - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size);
+        // We'll now determine whether some of the output is actually
+        // relevant to our redraw operation.
+        nof_relevant_lines
+          = current_history_screen_line
+          - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size);
 
-      TRACE_LOG("Number of relevant lines: %d.\n", nof_relevant_lines);
+        TRACE_LOG("Number of relevant lines: %d.\n", nof_relevant_lines);
       
-      lines_left = y_size;
-      if (nof_relevant_lines > 0) {
-        lines_left -= nof_relevant_lines;
-      }
+        lines_left = y_size;
+        if (nof_relevant_lines > 0) {
+          lines_left -= nof_relevant_lines;
+        }
 
-      TRACE_LOG("lines_left: %d.\n", lines_left);
+        TRACE_LOG("lines_left: %d.\n", lines_left);
 
-      if ( (lines_left> 0) && (return_code != 1) ) {
-        result |= refresh_window0_inner(
-            lines_left, y_refresh_top, &my_paragraph_diff);
+        if ( (lines_left> 0) && (return_code != 1) )
+          y_size = lines_left;
+        else
+          refresh_done = true;
       }
     }
-  }
-  else if ( (z_windows[0]->scrollback_top_line - (y_refresh_top - 1)
-        > current_history_screen_line) 
-      && (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
-        < current_history_screen_line) ) {
-    // 2. chsl between upper and lower refresh area bounds
-    TRACE_LOG("Scrolling case #2.\n");
-
-    original_pos = current_history_screen_line;
-    TRACE_LOG("original_pos: %d\n", original_pos);
-    TRACE_LOG("current_paragraph_index: %p\n",
-        history->current_paragraph_index);
-
-    z_windows[0]->remaining_lines_to_fill
-      = current_history_screen_line
-      - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size);
-
-    TRACE_LOG("Lines to fill below chsl: %d.\n",
-        z_windows[0]->remaining_lines_to_fill);
-
-    z_windows[0]->lowermargin
-      = z_windows[0]->ysize - ((y_refresh_top - 1) + y_size);
-    z_windows[0]->ycursorpos
-      //= z_windows[0]->lowermargin - z_windows[0]->remaining_lines_to_fill;
-      //= y_refresh_top + 1
-      //+ (z_windows[0]->scrollback_top_line - current_history_screen_line);
-      //= z_windows[0]->lowermargin - 1;
-      //= z_windows[0]->ysize - z_windows[0]->lowermargin;
-      //= y_refresh_top;
-      = z_windows[0]->scrollback_top_line - current_history_screen_line;
-
-    do {
-      TRACE_LOG("ycursorpos: %d\n", z_windows[0]->ycursorpos);
-      z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
-      z_windows[0]->ycursorpos++;
-      wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
-      z_windows[0]->nof_consecutive_lines_output = 0;
+    else if ( (z_windows[0]->scrollback_top_line - (y_refresh_top - 1)
+          > current_history_screen_line) 
+        && (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size
+          < current_history_screen_line) ) {
+      // 2. chsl between upper and lower refresh area bounds
+      TRACE_LOG("Scrolling case #2.\n");
+      TRACE_EVENT(TRACE_EVENT_REFRESH_CASE,
+          2, y_size, current_history_screen_line);
+
+      original_pos = current_history_screen_line;
+      nof_repeated_paragraphs = 0;
+      TRACE_LOG("original_pos: %d\n", original_pos);
+      TRACE_LOG("current_paragraph_index: %p\n",
+          history->current_paragraph_index);
+
+      z_windows[0]->remaining_lines_to_fill
+        = current_history_screen_line
+        - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1) - y_size);
 
-      refresh_cursor(0);
+      TRACE_LOG("Lines to fill below chsl: %d.\n",
+          z_windows[0]->remaining_lines_to_fill);
 
-      TRACE_LOG("Refresh at %d/%d with lower margin %d.\n",
-          z_windows[0]->xcursorpos, z_windows[0]->ycursorpos,
-          z_windows[0]->lowermargin);
+      z_windows[0]->lowermargin
+        = z_windows[0]->ysize - ((y_refresh_top - 1) + y_size);
+      z_windows[0]->ycursorpos
+        //= z_windows[0]->lowermargin - z_windows[0]->remaining_lines_to_fill;
+        //= y_refresh_top + 1
+        //+ (z_windows[0]->scrollback_top_line - current_history_screen_line);
+        //= z_windows[0]->lowermargin - 1;
+        //= z_windows[0]->ysize - z_windows[0]->lowermargin;
+        //= y_refresh_top;
+        = z_windows[0]->scrollback_top_line - current_history_screen_line;
+
+      do {
+        TRACE_LOG("ycursorpos: %d\n", z_windows[0]->ycursorpos);
+        z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
+        z_windows[0]->ycursorpos++;
+        wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
+        z_windows[0]->nof_consecutive_lines_output = 0;
 
-      return_code = output_repeat_paragraphs(history, 1, true, true);
-      TRACE_LOG("Return code: %d.\n", return_code);
-      /*
-      if (return_code == -1) {
-        TRACE_LOG("Error, remaining_lines_to_fill: %d.\n",
-            z_windows[0]->remaining_lines_to_fill);
-        i18n_translate_and_exit(
-            libmonospaceif_module_name,
-            i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
-            -0x0100,
-            "output_repeat_paragraphs");
+        refresh_cursor(0);
+
+        TRACE_LOG("Refresh at %d/%d with lower margin %d.\n",
+            z_windows[0]->xcursorpos, z_windows[0]->ycursorpos,
+            z_windows[0]->lowermargin);
+
+        return_code = output_repeat_paragraphs(history, 1, true, true);
+        monospace_stats.paragraphs_replayed++;
+        TRACE_LOG("Return code: %d.\n", return_code);
+        /*
+        if (return_code == -1) {
+          TRACE_LOG("Error, remaining_lines_to_fill: %d.\n",
+              z_windows[0]->remaining_lines_to_fill);
+          i18n_translate_and_exit(
+              libmonospaceif_module_name,
+              i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+              -0x0100,
+              "output_repeat_paragraphs");
+        }
+        */
+        nof_repeated_paragraphs++;
+        current_history_hit_top = false;
+        if (bool_equal(z_windows[0]->buffering, true))
+          wordwrap_flush_output(z_windows[0]->wordwrapper);
+        if (z_windows[0]->remaining_lines_to_fill > 0)
+          z_windows[0]->remaining_lines_to_fill--;
+        nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
+        current_history_screen_line += nof_paragraph_lines;
+        TRACE_LOG("last paragraph size %d, remaining_lines_to_fill: %d.\n",
+            nof_paragraph_lines, z_windows[0]->remaining_lines_to_fill);
+        TRACE_LOG("current_history_screen_line after output repeat: %d.\n",
+            current_history_screen_line);
+        TRACE_LOG("Cursor after refresh at %d/%d\n",
+            z_windows[0]->xcursorpos, z_windows[0]->ycursorpos);
       }
-      */
-      my_paragraph_diff++;
-      current_history_hit_top = false;
-      if (bool_equal(z_windows[0]->buffering, true))
-        wordwrap_flush_output(z_windows[0]->wordwrapper);
-      if (z_windows[0]->remaining_lines_to_fill > 0)
-        z_windows[0]->remaining_lines_to_fill--;
-      nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
-      current_history_screen_line += nof_paragraph_lines;
-      TRACE_LOG("last paragraph size %d, remaining_lines_to_fill: %d.\n",
-          nof_paragraph_lines, z_windows[0]->remaining_lines_to_fill);
-      TRACE_LOG("current_history_screen_line after output repeat: %d.\n",
-          current_history_screen_line);
-      TRACE_LOG("Cursor after refresh at %d/%d\n",
-          z_windows[0]->xcursorpos, z_windows[0]->ycursorpos);
-    }
-    while ( (z_windows[0]->remaining_lines_to_fill > 0) && (return_code >= 0) );
-    z_windows[0]->remaining_lines_to_fill = -1;
+      while ( (z_windows[0]->remaining_lines_to_fill > 0)
+          && (return_code >= 0) );
+      z_windows[0]->remaining_lines_to_fill = -1;
+
+      TRACE_LOG("Paragraphs to rewind: %d.\n", nof_repeated_paragraphs);
+      while (nof_repeated_paragraphs > 0) {
+        output_rewind_paragraph(history, NULL, NULL, NULL);
+        nof_repeated_paragraphs--;
+      }
+      current_history_screen_line = original_pos;
+      TRACE_LOG("current_paragraph_index: %p\n",
+          history->current_paragraph_index);
 
-    TRACE_LOG("Paragraphs to rewind: %d.\n", my_paragraph_diff);
-    while (my_paragraph_diff > 0) {
-      output_rewind_paragraph(history, NULL, NULL, NULL);
-      my_paragraph_diff--;
-    }
-    current_history_screen_line = original_pos;
-    TRACE_LOG("current_paragraph_index: %p\n",
-        history->current_paragraph_index);
+      TRACE_LOG("scrollback_top_line: %d, chsl: %d\n",
+          z_windows[0]->scrollback_top_line, current_history_screen_line);
 
-    TRACE_LOG("scrollback_top_line: %d, chsl: %d\n",
-        z_windows[0]->scrollback_top_line, current_history_screen_line);
+      // The next pass will refresh everything above the current position.
+      y_size = z_windows[0]->scrollback_top_line
+        - (y_refresh_top - 1) - current_history_screen_line;
 
-    refresh_window0_inner(z_windows[0]->scrollback_top_line
-        - (y_refresh_top - 1) - current_history_screen_line,
-        y_refresh_top, &my_paragraph_diff);
+      // Since in case #2 our history position is always between upper and
+      // lower refresh bounds, there has to be something we can display at
+      // least underneath the current position. Se, we can always return true.
+      result = true;
+    }
+    else {
+      // 3. chsl above or exactly on upper refresh-area boundary.
+      TRACE_LOG("Scrolling case #3.\n");
+      TRACE_EVENT(TRACE_EVENT_REFRESH_CASE,
+          3, y_size, current_history_screen_line);
 
-    // Since in case #2 our history position is always between upper and
-    // lower refresh bounds, there has to be something we can display at
-    // least underneath the current position. Se, we can always return true.
-    result = true;
-  }
-  else {
-    // 3. chsl above or exactly on upper refresh-area boundary.
-    TRACE_LOG("Scrolling case #3.\n");
+      z_windows[0]->lowermargin
+        = z_windows[0]->ysize - (y_refresh_top + (y_size - 1));
+      z_windows[0]->uppermargin = y_refresh_top - 1;
+      z_windows[0]->ycursorpos = z_windows[0]->uppermargin + 1;
+      z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
+      refresh_cursor(0);
 
-    z_windows[0]->lowermargin
-      = z_windows[0]->ysize - (y_refresh_top + (y_size - 1));
-    z_windows[0]->uppermargin = y_refresh_top - 1;
-    z_windows[0]->ycursorpos = z_windows[0]->uppermargin + 1;
-    z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
-    refresh_cursor(0);
+      TRACE_LOG("Lower margin: %d, upper: %d.\n",
+          z_windows[0]->lowermargin, z_windows[0]->uppermargin);
 
-    TRACE_LOG("Lower margin: %d, upper: %d.\n",
-        z_windows[0]->lowermargin, z_windows[0]->uppermargin);
+      z_windows[0]->lines_to_skip
+        = current_history_screen_line
+        - (z_windows[0]->scrollback_top_line - y_refresh_top + 1);
 
-    z_windows[0]->lines_to_skip
-      = current_history_screen_line
-      - (z_windows[0]->scrollback_top_line - y_refresh_top + 1);
+      z_windows[0]->remaining_lines_to_fill
+        = y_size;
 
-    z_windows[0]->remaining_lines_to_fill
-      = y_size;
+      while (z_windows[0]->remaining_lines_to_fill > 0) {
+        //if (z_windows[0]->lines_to_skip < 35) break;
+        if (bool_equal(z_windows[0]->buffering, true)) {
+          wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
+        }
+        z_windows[0]->nof_consecutive_lines_output = 0;
+        TRACE_LOG("remaining_lines_to_fill: %d.\n",
+            z_windows[0]->remaining_lines_to_fill);
+        if (is_output_at_frontindex(history) == true) {
+          TRACE_LOG("no more output, break.\n");
+          break;
+        }
 
-    while (z_windows[0]->remaining_lines_to_fill > 0) {
-      //if (z_windows[0]->lines_to_skip < 35) break;
-      if (bool_equal(z_windows[0]->buffering, true)) {
-        wordwrap_set_line_index(z_windows[0]->wordwrapper, 0);
-      }
-      z_windows[0]->nof_consecutive_lines_output = 0;
-      TRACE_LOG("remaining_lines_to_fill: %d.\n",
-          z_windows[0]->remaining_lines_to_fill);
-      if (is_output_at_frontindex(history) == true) {
-        TRACE_LOG("no more output, break.\n");
-        break;
-      }
+        return_code = output_repeat_paragraphs(history, 1, true, true);
+        monospace_stats.paragraphs_replayed++;
+        current_history_hit_top = false;
+        if (bool_equal(z_windows[0]->buffering, true)) {
+          wordwrap_flush_output(z_windows[0]->wordwrapper);
+        }
+        //screen_monospace_interface->update_screen();
+        //screen_monospace_interface->get_next_event(&input, -1);
+        if (z_windows[0]->lines_to_skip < 1) {
+          z_windows[0]->ycursorpos++;
+          TRACE_LOG("ycursorpos: %d\n", z_windows[0]->ycursorpos);
+          z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
+          refresh_cursor(0);
+        }
 
-      return_code = output_repeat_paragraphs(history, 1, true, true);
-      current_history_hit_top = false;
-      if (bool_equal(z_windows[0]->buffering, true)) {
-        wordwrap_flush_output(z_windows[0]->wordwrapper);
-      }
-      //screen_monospace_interface->update_screen();
-      //screen_monospace_interface->get_next_event(&input, -1);
-      if (z_windows[0]->lines_to_skip < 1) {
-        z_windows[0]->ycursorpos++;
-        TRACE_LOG("ycursorpos: %d\n", z_windows[0]->ycursorpos);
-        z_windows[0]->xcursorpos = 1 + z_windows[0]->leftmargin;
-        refresh_cursor(0);
-      }
+        // Compensate for missing newline after paragraph:
+        if (z_windows[0]->lines_to_skip > 0)
+          z_windows[0]->lines_to_skip--;
+        else if (z_windows[0]->remaining_lines_to_fill > 0)
+          z_windows[0]->remaining_lines_to_fill--;
 
-      // Compensate for missing newline after paragraph:
-      if (z_windows[0]->lines_to_skip > 0)
-        z_windows[0]->lines_to_skip--;
-      else if (z_windows[0]->remaining_lines_to_fill > 0)
-        z_windows[0]->remaining_lines_to_fill--;
 
-      my_paragraph_diff++;
+        TRACE_LOG("Lines to skip: %d.\n",
+            z_windows[0]->lines_to_skip);
+        TRACE_LOG("current_history_screen_line: %d.\n",
+            current_history_screen_line);
 
-      TRACE_LOG("Lines to skip: %d.\n",
-          z_windows[0]->lines_to_skip);
-      TRACE_LOG("current_history_screen_line: %d.\n",
-          current_history_screen_line);
+        nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
+        current_history_screen_line -= nof_paragraph_lines;
+        if ( (return_code < 0) && (current_history_screen_line != 0) ) {
+          TRACE_LOG("history inconsistent, buffer end at chsl: %d.\n",
+              current_history_screen_line);
+          i18n_translate_and_exit(
+              libmonospaceif_module_name,
+              i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
+              -0x0100,
+              "output_rewind_paragraph");
+        }
 
-      nof_paragraph_lines = z_windows[0]->nof_consecutive_lines_output + 1;
-      current_history_screen_line -= nof_paragraph_lines;
-      if ( (return_code < 0) && (current_history_screen_line != 0) ) {
-        TRACE_LOG("history inconsistent, buffer end at chsl: %d.\n",
-            current_history_screen_line);
-        i18n_translate_and_exit(
-            libmonospaceif_module_name,
-            i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
-            -0x0100,
-            "output_rewind_paragraph");
-      }
+        /*
+        nof_relevant_lines
+          = current_history_screen_line
+          - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1));
 
-      /*
-      nof_relevant_lines
-        = current_history_screen_line
-        - (z_windows[0]->scrollback_top_line - (y_refresh_top - 1));
+        TRACE_LOG("nof_relevant_lines: %d\n", nof_relevant_lines);
+        */
+      }
 
-      TRACE_LOG("nof_relevant_lines: %d\n", nof_relevant_lines);
-      */
+      result = true;
+      refresh_done = true;
+      // Since case #3 deals with a position at the top or above the top
+      // position to display, we know there must be some output to display
+      // in the refresh window and can accordingly always return true.
     }
-
-    result = true;
-    // Since case #3 deals with a position at the top or above the top
-    // position to display, we know there must be some output to display
-    // in the refresh window and can accordingly always return true.
   }
-  z_windows[0]->uppermargin = 0;
 
-  if (nof_paragraph_diff != NULL)
-    *nof_paragraph_diff += my_paragraph_diff;
+  z_windows[0]->uppermargin = 0;
 
   TRACE_LOG("Returning %d from refresh_window0_inner.\n", result);
+  TRACE_EVENT(TRACE_EVENT_REFRESH_END,
+      result, current_history_screen_line, 0);
   return result;
 }
 
 
-static void init_output_history() {
+// Returns the width available for text in window 0, which is what the
+// paragraph heights depend on.
+static int get_window0_line_width() {
+  return z_windows[0]->xsize
+    - z_windows[0]->leftmargin
+    - z_windows[0]->rightmargin;
+}
+
+
+// The history output is kept between refreshes and turns, new output only
+// leaves it behind the front, see "advance_output_history".
+static void discard_output_history() {
   if (history != NULL) {
     TRACE_LOG("Destroying history output.\n");
     destroy_history_output(history);
     history = NULL;
+    current_history_screen_line = -1;
     current_history_hit_top = false;
   }
+}
 
-  //if (current_history_screen_line != 0) {
-  //
-  if ((history = init_history_output(
-          outputhistory[0],
-          &history_target,
-          Z_HISTORY_OUTPUT_WITHOUT_EXTRAS)) == NULL) {
-    i18n_translate_and_exit(
+
+// Once libfizmo's output history is full, appending output overwrites the
+// oldest paragraphs, and a realloc may move all of them. Since the history
+// doesn't tell whether either happened, and a wrap may take the front past
+// its old position, a new generation of positions is started whenever the
+// front has moved at all.
+static void check_history_front(void *front) {
+  if ( (last_history_front != NULL) && (front != last_history_front) ) {
+    TRACE_LOG("History front moved, starting generation %lu.\n",
+        history_generation + 1);
+    history_generation++;
+  }
+
+  last_history_front = front;
+}
+
+
+// Moves the history output forward to the front over the paragraphs
+// stored since it was last used, without drawing them. Returns false if
+// the front is too far away.
+static bool advance_output_history() {
+  int i;
+
+  advancing_history = true;
+  for (i=0;
+      (i < MAX_HISTORY_ADVANCE_PARAGRAPHS)
+      && (is_output_at_frontindex(history) == false);
+      i++)
+    if (output_repeat_paragraphs(history, 1, true, true) < 0)
+      break;
+  advancing_history = false;
+
+  TRACE_LOG("Advanced history output over %d paragraphs.\n", i);
+  return is_output_at_frontindex(history);
+}
+
+
+static void init_output_history() {
+  // A history output which is back at the front is in the same state as
+  // a new one, so it's simply used again.
+  if ( (history != NULL)
+      && (current_history_hit_top == false)
+      && (advance_output_history() == true) ) {
+    TRACE_LOG("Re-using history output at: %p\n", history);
+    check_history_front((void*)history->current_paragraph_index);
+    current_history_screen_line = 0;
+    scrollback_index_reset(
+        (void*)history->current_paragraph_index,
+        history_generation,
+        get_window0_line_width());
+    return;
+  }
+
+  discard_output_history();
+
+  //if (current_history_screen_line != 0) {
+  //
+  if ((history = init_history_output(
+          outputhistory[0],
+          &history_target,
+          Z_HISTORY_OUTPUT_WITHOUT_EXTRAS)) == NULL) {
+    i18n_translate_and_exit(
         libmonospaceif_module_name,
         i18n_libmonospaceif_FUNCTION_CALL_P0S_ABORTED_DUE_TO_ERROR,
         -0x0100,
@@ -1795,7 +2223,12 @@ static void init_output_history() {
   }
 
   TRACE_LOG("History initialized at: %p\n", history);
+  check_history_front((void*)history->current_paragraph_index);
   current_history_screen_line = 0;
+  scrollback_index_reset(
+      (void*)history->current_paragraph_index,
+      history_generation,
+      get_window0_line_width());
   //current_history_screen_line = -1;
 }
 
@@ -1815,12 +2248,14 @@ static bool refresh_window0(int y_size, int y_refresh_top, bool reset_history) {
   int last_active_z_window_id = -1;
   bool result;
 
+  monospace_stats.window0_refreshes++;
+
   if ( (reset_history == true) || (history == NULL) ) {
     init_output_history();
   }
 
   if (input_line_on_screen == true)
-    *current_input_y = z_windows[0]->ypos + z_windows[0]->ysize - 1;
+    current_line_input->input_y = z_windows[0]->ypos + z_windows[0]->ysize - 1;
 
   if (active_z_window_id != 0) {
     last_active_z_window_id = active_z_window_id;
@@ -1839,7 +2274,9 @@ static bool refresh_window0(int y_size, int y_refresh_top, bool reset_history) {
   }
   */
 
-  result = refresh_window0_inner(y_size, y_refresh_top, NULL);
+  replaying_history = true;
+  result = refresh_window0_inner(y_size, y_refresh_top);
+  replaying_history = false;
   TRACE_LOG("Final refresh_window0_inner result: %d.\n", result);
   screen_monospace_interface->set_text_style(0);
 
@@ -1853,7 +2290,7 @@ static bool refresh_window0(int y_size, int y_refresh_top, bool reset_history) {
 
   if (z_windows[0]->scrollback_top_line <= z_windows[0]->ysize) {
     if (input_line_on_screen == true) {
-      // current_input_x and current_input_y have already been adjusted
+      // The input line's position has already been adjusted
       // in "refresh_window0_inner".
 
       //z_windows[0]->ycursorpos = *current_input_y - 1;
@@ -1887,193 +2324,320 @@ static bool refresh_window0(int y_size, int y_refresh_top, bool reset_history) {
 
 
 static void refresh_screen() {
-  z_ucs *blockbuf_line;
-  int i, j;
-  int block_index, output_index;
+  // Resizing refreshes the screen as well, for the new size.
+  if (resize_pending == true) {
+    apply_pending_resize();
+    return;
+  }
 
   erase_window(0);
   //z_windows[0]->scrollback_top_line = z_windows[0]->ysize - 1;
   refresh_window0(z_windows[0]->ysize, 1, true);
 
-  if (ver <= 3)
+  if (ver <= 3) {
+    status_line_valid = false;
     display_status_line();
+  }
 
-  // FIXME: Add color and styles.
   if (z_windows[1]->ysize > 0) {
     TRACE_LOG("Redrawing upper window (%d).\n", z_windows[1]->xsize);
-    blockbuf_line = fizmo_malloc(sizeof(z_ucs) * (z_windows[1]->xsize + 1));
+    upper_window_cache_redraw(
+        screen_monospace_interface,
+        z_windows[1]->ysize,
+        z_windows[1]->xsize,
+        ver <= 3 ? 2 : 1,
+        using_colors,
+        &current_output_text_style,
+        &current_output_foreground_colour,
+        &current_output_background_colour);
+  }
 
-    //upper_font = upper_window_buffer->content[0].font;
-    current_output_text_style
-      = upper_window_buffer->content[0].style;
-    current_output_foreground_colour
-      = upper_window_buffer->content[0].foreground_colour;
-    current_output_background_colour
-      = upper_window_buffer->content[0].background_colour;
+  update_output_colours(0);
+  update_output_text_style(0);
+  refresh_cursor(0);
 
-    // z_windows[window_number]->output_text_style
+  screen_monospace_interface->redraw_screen_from_scratch();
+}
 
-    //screen_monospace_interface->set_font(upper_font);
-    screen_monospace_interface->set_text_style(current_output_text_style);
-    if (using_colors == true)
-      screen_monospace_interface->set_colour(
-          current_output_foreground_colour, current_output_background_colour);
-
-    for (i=0; i<z_windows[1]->ysize; i++) {
-      TRACE_LOG("Line %d.\n", i);
-      block_index = i * upper_window_buffer->width;
-
-      j = 0;
-      screen_monospace_interface->goto_yx(i + (ver <= 3 ? 2 : 1), 1);
-
-      while ( (j < z_windows[1]->xsize)
-          && (j < upper_window_buffer->width)) {
-        output_index = 0;
-
-        while (
-            (j < z_windows[1]->xsize)
-            &&
-            (j < upper_window_buffer->width)
-            /*
-            &&
-            (upper_window_buffer->content[block_index].font
-             == upper_font)
-            */
-            &&
-            (upper_window_buffer->content[block_index].style
-             == current_output_text_style)
-            &&
-            (
-             (upper_window_buffer->content[block_index].foreground_colour
-              == current_output_foreground_colour)
-             ||
-             (upper_window_buffer->content[block_index].foreground_colour == 0)
-            )
-            &&
-            (
-             (upper_window_buffer->content[block_index].background_colour
-              == current_output_background_colour)
-             ||
-             (upper_window_buffer->content[block_index].background_colour == 0)
-            )) {
-          blockbuf_line[output_index]
-            = upper_window_buffer->content[block_index].character;
-          block_index++;
-          output_index++;
-          j++;
-        }
-        blockbuf_line[output_index] = 0;
-        screen_monospace_interface->z_ucs_output(blockbuf_line);
-
-        if ( (j < z_windows[1]->xsize)
-            && (j < upper_window_buffer->width)) {
-          TRACE_LOG("New style/colour at column %d.\n", j);
-          /*
-          if (upper_window_buffer->content[block_index].font != upper_font)
-          {
-            upper_font = upper_window_buffer->content[block_index].font;
-            screen_monospace_interface->set_font(upper_font);
-          }
-          */
 
-          if (upper_window_buffer->content[block_index].style
-              != current_output_text_style) {
-            current_output_text_style
-              = upper_window_buffer->content[block_index].style;
-            screen_monospace_interface->set_text_style(current_output_text_style);
-          }
+static void resize_screen(int newysize, int newxsize);
 
-          if (
-              (
-               (upper_window_buffer->content[block_index].foreground_colour
-                != current_output_foreground_colour)
-               &&
-               (upper_window_buffer->content[block_index].foreground_colour!=0)
-              )
-              ||
-              (
-               (upper_window_buffer->content[block_index].background_colour
-                != current_output_background_colour)
-               &&
-               (upper_window_buffer->content[block_index].background_colour!=0)
-              )
-             )
-          {
-            if (upper_window_buffer->content[block_index].foreground_colour!=0)
-              current_output_foreground_colour
-                = upper_window_buffer->content[block_index].foreground_colour;
-            if (upper_window_buffer->content[block_index].background_colour!=0)
-              current_output_background_colour
-                = upper_window_buffer->content[block_index].background_colour;
-            if (using_colors == true)
-              screen_monospace_interface->set_colour(
-                  current_output_foreground_colour,
-                  current_output_background_colour);
-          }
-        }
-      }
-    }
 
-    /*
-    screen_monospace_interface->set_text_style(
-        current_output_text_style);
+static void apply_pending_resize() {
+  if (resize_pending == false)
+    return;
 
-    screen_monospace_interface->set_colour(
-        z_windows[window_number]->output_foreground_colour,
-        z_windows[window_number]->output_background_colour);
-    */
+  resize_pending = false;
+  resize_screen(pending_screen_height, pending_screen_width);
+}
 
-    free(blockbuf_line);
-  }
 
-  update_output_colours(0);
-  update_output_text_style(0);
-  refresh_cursor(0);
+static int64_t get_monotonic_millis() {
+  struct timespec now;
 
-  screen_monospace_interface->redraw_screen_from_scratch();
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
 
-// NOTE: Keep in mind that the verification routine may recursively
-// call a read (Border Zone does this).
-// This function reads a maximum of maximum_length characters from stdin
-// to dest. The number of characters read is returned. The input is NOT
-// terminated with a newline (in order to conform to V5+ games).
-// Returns -1 when int routine returns != 0
-// Returns -2 when user ended input with ESC
-static int16_t read_line(zscii *dest, uint16_t maximum_length,
+static void start_timed_input(struct timed_input *timed_input,
     uint16_t tenth_seconds, uint32_t verification_routine,
-    uint8_t preloaded_input, int *tenth_seconds_elapsed,
-    bool disable_command_history, bool return_on_escape)
-{
-  z_ucs input, buf;
-  int timeout_millis = -1, event_type, i;
-  bool input_in_progress = true, redraw_result;
-  z_ucs char_buf[] = { 0, 0 };
-  //int original_screen_width = screen_width;
-  //int original_screen_height = screen_height;
-  int input_size = preloaded_input;
-  int input_scroll_x = 0;
-  int input_index = preloaded_input;
-  int input_display_width; // Width of the input line on-screen.
-  int input_x, input_y; // Leftmost position of the input line on-screen.
-  z_ucs input_buffer[maximum_length + 1];
-  int cmd_history_index = 0;
-  zscii *cmd_history_ptr;
-  int current_tenth_seconds = 0;
-  int timed_routine_retval, index;
+    int *tenth_seconds_elapsed) {
+
+  if ((tenth_seconds == 0) || (verification_routine == 0)) {
+    timed_input->active = false;
+    return;
+  }
+
+  TRACE_LOG("timed input every %d tenth seconds.\n", tenth_seconds);
+
+  timed_input->active = true;
+  timed_input->interval_millis = (int64_t)tenth_seconds * 100;
+  timed_input->start_millis = get_monotonic_millis();
+  timed_input->deadline_millis
+    = timed_input->start_millis + timed_input->interval_millis;
+
+  if (tenth_seconds_elapsed != NULL)
+    *tenth_seconds_elapsed = 0;
+}
+
+
+// Returns the "timeout_millis" to wait for the next event with. Since 0
+// means waiting without timeout, a deadline which has already passed
+// yields 1.
+static int get_timed_input_timeout(struct timed_input *timed_input) {
+  int64_t remaining_millis;
+
+  if ( (timed_input->active == false)
+      || (is_timed_keyboard_input_available() == false) )
+    return 0;
+
+  remaining_millis = timed_input->deadline_millis - get_monotonic_millis();
+
+  if (remaining_millis < 1)
+    return 1;
+  else if (remaining_millis > INT32_MAX)
+    return INT32_MAX;
+  else
+    return (int)remaining_millis;
+}
+
+
+// Returns true in case the verification routine is due and advances the
+// deadline by one interval. "tenth_seconds_elapsed" is set from the clock,
+// so it stays correct when wakeups are late. After falling behind by more
+// than one interval, for example since the routine itself took so long,
+// the next deadline is counted from now instead of calling the routine
+// several times in a row.
+static bool is_timed_input_due(struct timed_input *timed_input,
+    int *tenth_seconds_elapsed) {
+  int64_t now_millis;
+
+  if (timed_input->active == false)
+    return false;
+
+  now_millis = get_monotonic_millis();
+
+  if (tenth_seconds_elapsed != NULL)
+    *tenth_seconds_elapsed
+      = (int)((now_millis - timed_input->start_millis) / 100);
+
+  if (now_millis < timed_input->deadline_millis)
+    return false;
+
+  timed_input->deadline_millis += timed_input->interval_millis;
+  if (timed_input->deadline_millis <= now_millis)
+    timed_input->deadline_millis = now_millis + timed_input->interval_millis;
+
+  return true;
+}
+
+
+// Waits for the next event like the backend's "get_next_event". In case
+// a resize is pending, it's applied only after the backend hasn't
+// reported another one for RESIZE_QUIET_PERIOD_MILLIS or when other input
+// arrives, so that a series of resize events is drawn only once. The
+// quiet period counts towards "timeout_millis", resize events don't.
+static int get_next_input_event(z_ucs *input, int timeout_millis) {
+  int event_type, wait_millis;
+
+  while (resize_pending == true) {
+    if (is_timed_keyboard_input_available() == false) {
+      apply_pending_resize();
+      break;
+    }
+
+    wait_millis = RESIZE_QUIET_PERIOD_MILLIS;
+    if ( (timeout_millis > 0) && (timeout_millis < wait_millis) )
+      wait_millis = timeout_millis;
+
+    event_type = screen_monospace_interface->get_next_event(
+        input, wait_millis);
+
+    if (event_type == EVENT_WAS_WINCH) {
+      new_monospace_screen_size(
+          screen_monospace_interface->get_screen_height(),
+          screen_monospace_interface->get_screen_width());
+      continue;
+    }
+
+    apply_pending_resize();
+
+    if (event_type != EVENT_WAS_TIMEOUT)
+      return event_type;
+
+    if (timeout_millis > 0) {
+      timeout_millis -= wait_millis;
+      if (timeout_millis <= 0)
+        return EVENT_WAS_TIMEOUT;
+    }
+  }
+
+  return screen_monospace_interface->get_next_event(input, timeout_millis);
+}
+
+
+// Pages window 0 up or down by half its height through the history.
+static void scroll_back(int event_type) {
   int scroll_area_ysize;
-  int new_width, new_height;
+  bool redraw_result;
 
-  current_input_size = &input_size;
-  current_input_scroll_x = &input_scroll_x;
-  current_input_index = &input_index;
-  current_input_display_width = &input_display_width;
-  current_input_x = &input_x;
-  current_input_y = &input_y;
-  current_input_buffer = input_buffer;
+  scroll_area_ysize = z_windows[0]->ysize / 2;
+  TRACE_LOG("scroll_area_ysize: %d.\n", scroll_area_ysize);
+  // "scroll_area_ysize" denotes the area which we're refreshing, not(!)
+  // the area we're copying on-screen. Example: In case the screen has
+  // height 29, we're copying 15 lines of existing screen contents and
+  // refresh the remaining 14 lines.
+
+  // FIXME: Cursor not at bottom, have to redraw everything.
+  if ( (event_type == EVENT_WAS_CODE_PAGE_UP)
+      && (current_history_hit_top == false) ) {
+    z_windows[0]->scrollback_top_line += scroll_area_ysize;
+    TRACE_LOG("scrollback_top_line: %d.\n",
+        z_windows[0]->scrollback_top_line);
+
+    if (z_windows[0]->ycursorpos != z_windows[0]->ysize) {
+      TRACE_LOG("Cursor not at bottom, have to redraw everything.\n");
+      screen_monospace_interface->clear_area(
+          z_windows[0]->xpos,
+          z_windows[0]->ypos,
+          screen_width,
+          z_windows[0]->ysize);
+      redraw_result = refresh_window0(
+          z_windows[0]->ysize,
+          1,
+          true);
+    }
+    else {
+      TRACE_LOG("Cursor at bottom, copying and refreshing half screen.\n");
+      if (scroll_window_rows(
+            0,
+            z_windows[0]->ypos,
+            z_windows[0]->ypos + z_windows[0]->ysize - 1,
+            -scroll_area_ysize) == false)
+        screen_monospace_interface->clear_area(
+            z_windows[0]->xpos,
+            z_windows[0]->ypos,
+            screen_width,
+            scroll_area_ysize);
+      redraw_result = refresh_window0(
+          scroll_area_ysize,
+          1,
+          false);
+    }
+
+    if (redraw_result == false) {
+      TRACE_LOG("Area to display outside history bounds.\n");
+      z_windows[0]->scrollback_top_line -= scroll_area_ysize;
+      // Clear window before redraw: Although we've already cleared
+      // window 0 above and the return code of refresh_window0 shows
+      // there was no output in the meantime, the "copy_area" above
+      // may have written to areas which will be left empty by the
+      // "refresh_window0" further below.
+      screen_monospace_interface->clear_area(
+          z_windows[0]->xpos,
+          z_windows[0]->ypos,
+          screen_width,
+          z_windows[0]->ysize);
+      refresh_window0(
+          z_windows[0]->ysize,
+          1,
+          true);
+    }
+
+    TRACE_LOG("Finished page-up repainting.\n");
+  }
+  else if ( (event_type == EVENT_WAS_CODE_PAGE_DOWN)
+      && (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) ) {
+    z_windows[0]->scrollback_top_line -= scroll_area_ysize;
+    if (scroll_window_rows(
+          0,
+          z_windows[0]->ypos,
+          z_windows[0]->ypos + z_windows[0]->ysize - 1,
+          scroll_area_ysize) == false)
+      screen_monospace_interface->clear_area(
+          z_windows[0]->xpos,
+          z_windows[0]->ypos
+          + (z_windows[0]->ysize - scroll_area_ysize),
+          screen_width,
+          scroll_area_ysize);
+    refresh_window0(
+        scroll_area_ysize,
+        1 + (z_windows[0]->ysize - scroll_area_ysize),
+        false);
+    TRACE_LOG("Finished page-down repainting.\n");
+  }
+
+  screen_monospace_interface->set_cursor_visibility(
+      z_windows[0]->scrollback_top_line > z_windows[0]->ysize
+      ? false : true);
+
+  screen_monospace_interface->update_screen();
+}
+
+
+// Returns from scrollback to the bottom of window 0, called for every
+// event which doesn't page through the history.
+static void leave_scrollback() {
+  if (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) {
+    erase_window(0);
+    z_windows[0]->scrollback_top_line = z_windows[0]->ysize;
+    refresh_window0(z_windows[0]->ysize, 1, false);
+    screen_monospace_interface->set_cursor_visibility(true);
+    screen_monospace_interface->update_screen();
+  }
+
+  // Paging up stops once the top of the history has been hit, which has
+  // to be reset for the next time.
+  if (current_history_hit_top == true)
+    discard_output_history();
+}
+
+
+static void begin_line_input(struct line_input *line, zscii *dest,
+    uint16_t maximum_length, uint16_t tenth_seconds,
+    uint32_t verification_routine, uint8_t preloaded_input,
+    int *tenth_seconds_elapsed, bool disable_command_history,
+    bool return_on_escape) {
+  int i;
+
+  line->dest = dest;
+  line->maximum_length = maximum_length;
+  line->verification_routine = verification_routine;
+  line->tenth_seconds_elapsed = tenth_seconds_elapsed;
+  line->disable_command_history = disable_command_history;
+  line->return_on_escape = return_on_escape;
+  line->input_in_progress = true;
+  line->input_size = preloaded_input;
+  line->input_scroll_x = 0;
+  line->input_index = preloaded_input;
+  line->cmd_history_index = 0;
+
+  current_line_input = line;
 
   TRACE_LOG("maxlen:%d, preload: %d.\n", maximum_length, preloaded_input);
+  TRACE_EVENT(TRACE_EVENT_READ_LINE_START,
+      maximum_length, tenth_seconds, preloaded_input);
 
   flush_all_buffered_windows();
   for (i=0; i<nof_active_z_windows; i++)
@@ -2104,753 +2668,557 @@ static int16_t read_line(zscii *dest, uint16_t maximum_length,
   TRACE_LOG("1/10s: %d, routine: %d.\n",
       tenth_seconds, verification_routine);
 
-  if ((tenth_seconds != 0) && (verification_routine != 0))
-  {
-    TRACE_LOG("timed input in read_line every %d tenth seconds.\n",
-        tenth_seconds);
-
-    timed_input_active = true;
-
-    timeout_millis = (is_timed_keyboard_input_available() == true ? 100 : 0);
-
-    if (tenth_seconds_elapsed != NULL)
-      *tenth_seconds_elapsed = 0;
-  }
-  else
-  {
-    timeout_millis = 0;
-    timed_input_active = false;
-  }
+  start_timed_input(&line->timed_input,
+      tenth_seconds, verification_routine, tenth_seconds_elapsed);
 
   screen_monospace_interface->update_screen();
   update_output_colours(active_z_window_id);
   update_output_text_style(active_z_window_id);
 
-  input_x
+  line->input_x
     = z_windows[active_z_window_id]->xpos
     + z_windows[active_z_window_id]->xcursorpos - 1
     - preloaded_input;
 
-  input_y
+  line->input_y
     = z_windows[active_z_window_id]->ypos
     + z_windows[active_z_window_id]->ycursorpos - 1;
 
-  input_display_width
+  line->input_display_width
     = z_windows[active_z_window_id]->xsize
     - (z_windows[active_z_window_id]->xcursorpos - 1 - preloaded_input)
     - z_windows[active_z_window_id]->rightmargin;
 
-  TRACE_LOG("input_x:%d, input_y:%d.\n", input_x, input_y);
-  TRACE_LOG("input width: %d.\n", input_display_width);
+  TRACE_LOG("input_x:%d, input_y:%d.\n", line->input_x, line->input_y);
+  TRACE_LOG("input width: %d.\n", line->input_display_width);
 
+  input_line_reset(maximum_length);
   for (i=0; i<preloaded_input; i++)
-    input_buffer[i] = zscii_input_char_to_z_ucs(dest[i]);
-  input_buffer[i] = 0;
+    input_line_insert(i, zscii_input_char_to_z_ucs(dest[i]));
+  // Preloaded input is already on-screen, the rest of the line is empty.
+  input_line_screen_is_blank();
+  input_line_screen_shows_input(0, line->input_display_width);
 
   input_line_on_screen = true;
+}
 
-  while (input_in_progress == true)
+
+// Processes a single event, "input_in_progress" is set to false once the
+// input is complete.
+static void process_line_input_event(struct line_input *line,
+    int event_type, z_ucs input) {
+  int i;
+  int input_column; // Cursor position relative to "input_x".
+  zscii *cmd_history_ptr;
+  int timed_routine_retval;
+  int new_width, new_height;
+
+  TRACE_LOG("Evaluating event %d.\n", event_type);
+  TRACE_EVENT(TRACE_EVENT_READ_LINE_EVENT,
+      event_type, input, line->input_index);
+  TRACE_LOG("current_history_hit_top: %d.\n", current_history_hit_top);
+
+  if (event_type == EVENT_WAS_TIMEOUT)
   {
-    event_type = screen_monospace_interface->get_next_event(
-        &input, timeout_millis);
-    TRACE_LOG("Evaluating event %d.\n", event_type);
-    TRACE_LOG("current_history_hit_top: %d.\n", current_history_hit_top);
+    // Don't forget to restore the input line on recursive read.
+    TRACE_LOG("timeout found.\n");
 
-    if (event_type == EVENT_WAS_TIMEOUT)
+    if (line->timed_input.active == true)
     {
-      // Don't forget to restore current_input_buffer on recursive read.
-      TRACE_LOG("timeout found.\n");
-
-      if (timed_input_active == true)
+      if (is_timed_input_due(
+            &line->timed_input, line->tenth_seconds_elapsed) == true)
       {
-        current_tenth_seconds++;
-        TRACE_LOG("%d / %d.\n", current_tenth_seconds, tenth_seconds);
-        if (tenth_seconds_elapsed != NULL)
-          (*tenth_seconds_elapsed)++;
-
-        if (current_tenth_seconds == tenth_seconds)
-        {
-          current_tenth_seconds = 0;
-          stream_output_has_occured = false;
+        stream_output_has_occured = false;
 
-          TRACE_LOG("calling timed-input-routine at %x.\n",
-              verification_routine);
-          timed_routine_retval = interpret_from_call(verification_routine);
-          TRACE_LOG("timed-input-routine finished.\n");
+        TRACE_LOG("calling timed-input-routine at %x.\n",
+            line->verification_routine);
+        timed_routine_retval = interpret_from_call(line->verification_routine);
+        TRACE_LOG("timed-input-routine finished.\n");
 
-          if (terminate_interpreter != INTERPRETER_QUIT_NONE)
+        if (terminate_interpreter != INTERPRETER_QUIT_NONE)
+        {
+          TRACE_LOG("Quitting after verification.\n");
+          line->input_in_progress = false;
+          line->input_size = 0;
+        }
+        else
+        {
+          if (stream_output_has_occured == true)
           {
-            TRACE_LOG("Quitting after verification.\n");
-            input_in_progress = false;
-            input_size = 0;
+            flush_all_buffered_windows();
+            refresh_input_line();
+            z_windows[active_z_window_id]->xcursorpos
+              = line->input_size > line->input_display_width
+              ? line->input_x + line->input_display_width
+              : line->input_x + line->input_size;
+            screen_monospace_interface->update_screen();
           }
-          else
-          {
-            if (stream_output_has_occured == true)
-            {
-              flush_all_buffered_windows();
-              refresh_input_line();
-              z_windows[active_z_window_id]->xcursorpos
-                = *current_input_size > *current_input_display_width
-                ? *current_input_x + *current_input_display_width
-                : *current_input_x + *current_input_size;
-              screen_monospace_interface->update_screen();
-            }
 
-            if (timed_routine_retval != 0)
-            {
-              input_in_progress = false;
-              input_size = 0;
-            }
+          if (timed_routine_retval != 0)
+          {
+            line->input_in_progress = false;
+            line->input_size = 0;
           }
         }
       }
     }
-    else if (
-        (event_type == EVENT_WAS_CODE_PAGE_UP)
-        || (event_type == EVENT_WAS_CODE_PAGE_DOWN)
-        ) {
-      scroll_area_ysize = z_windows[0]->ysize / 2;
-      TRACE_LOG("scroll_area_ysize: %d.\n", scroll_area_ysize);
-      // "scroll_area_ysize" denotes the area which we're refreshing, not(!)
-      // the area we're copying on-screen. Example: In case the screen has
-      // height 29, we're copying 15 lines of existing screen contents and
-      // refresh the remaining 14 lines.
-
-      // FIXME: Cursor not at bottom, have to redraw everything.
-      if ( (event_type == EVENT_WAS_CODE_PAGE_UP)
-          && (current_history_hit_top == false) ) {
-        z_windows[0]->scrollback_top_line += scroll_area_ysize;
-        TRACE_LOG("scrollback_top_line: %d.\n",
-            z_windows[0]->scrollback_top_line);
-
-        if (z_windows[0]->ycursorpos != z_windows[0]->ysize) {
-          TRACE_LOG("Cursor not at bottom, have to redraw everything.\n");
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              z_windows[0]->ysize);
-          redraw_result = refresh_window0(
-              z_windows[0]->ysize,
-              1,
-              true);
+  }
+  else if (
+      (event_type == EVENT_WAS_CODE_PAGE_UP)
+      || (event_type == EVENT_WAS_CODE_PAGE_DOWN)
+      ) {
+    scroll_back(event_type);
+  }
+  else
+  {
+    leave_scrollback();
+
+    if (event_type == EVENT_WAS_INPUT)
+    {
+      if (input == Z_UCS_NEWLINE)
+      {
+        line->input_in_progress = false;
+      }
+      else if (input == 12)
+      {
+        TRACE_LOG("Got CTRL-L.\n");
+        //erase_window(0);
+        //refresh_window0(z_windows[0]->ysize, 1, true);
+        //screen_monospace_interface->redraw_screen_from_scratch();
+        refresh_screen();
+      }
+      else if (input == 18)
+      {
+        TRACE_LOG("Got CTRL-R.\n");
+        new_monospace_screen_size(
+            screen_monospace_interface->get_screen_height(),
+            screen_monospace_interface->get_screen_width());
+      }
+      else if (
+          // Check if we have a valid input char.
+          (unicode_char_to_zscii_input_char(input) != 0xff)
+          &&
+          (
+           // We'll also only add new input if we're either not at the end
+           // of a filled input line ...
+           (line->input_size < line->maximum_length)
+           ||
+           // ... or if the cursor is left of the input end.
+           (line->input_index < line->input_size)
+          )
+          )
+      {
+        TRACE_LOG("New ZSCII input char %d / z_ucs code %d.\n",
+            unicode_char_to_zscii_input_char(input), input);
+
+        TRACE_LOG("input_index: %d, input_size: %d, maximum_length: %d.\n",
+            line->input_index, line->input_size, line->maximum_length);
+
+        input_column
+          = z_windows[active_z_window_id]->xpos
+          + z_windows[active_z_window_id]->xcursorpos - 1 - line->input_x;
+
+        // In case the input line is full, we'll lose the rightmost char
+        // to make room for the new one.
+        if (line->input_size < line->maximum_length)
+          line->input_size++;
+        else
+          input_line_delete(line->input_size - 1);
+
+        input_line_insert(line->input_index, input);
+        line->input_index++;
+
+        TRACE_LOG("xcp %d, rm %d, xs: %d.\n",
+            z_windows[active_z_window_id]->xcursorpos,
+            z_windows[active_z_window_id]->rightmargin,
+            z_windows[active_z_window_id]->xsize);
+
+        if (z_windows[active_z_window_id]->xcursorpos
+            + z_windows[active_z_window_id]->rightmargin
+            == z_windows[active_z_window_id]->xsize) {
+          TRACE_LOG("Input at rightmost position.\n");
+          shift_line_input(line, 1, line->input_display_width - 1, -1);
+          line->input_scroll_x++;
         }
         else {
-          TRACE_LOG("Cursor at bottom, copying and refreshing half screen.\n");
-          screen_monospace_interface->copy_area(
-              z_windows[0]->ypos + scroll_area_ysize,
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              z_windows[0]->xpos,
-              z_windows[0]->ysize - scroll_area_ysize,
-              z_windows[0]->xsize);
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              scroll_area_ysize);
-          redraw_result = refresh_window0(
-              scroll_area_ysize,
-              1,
-              false);
+          // Everything right of the cursor moves one column to the right.
+          if (line->input_index < line->input_size)
+            shift_line_input(line,
+                input_column, line->input_display_width - 1 - input_column, 1);
+          z_windows[active_z_window_id]->xcursorpos++;
         }
 
-        if (redraw_result == false) {
-          TRACE_LOG("Area to display outside history bounds.\n");
-          z_windows[0]->scrollback_top_line -= scroll_area_ysize;
-          // Clear window before redraw: Although we've already cleared
-          // window 0 above and the return code of refresh_window0 shows
-          // there was no output in the meantime, the "copy_area" above
-          // may have written to areas which will be left empty by the
-          // "refresh_window0" further below.
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              z_windows[0]->ysize);
-          refresh_window0(
-              z_windows[0]->ysize,
-              1,
-              true);
-        }
+        TRACE_LOG("out:%d, %d, %d\n",
+            line->input_size, line->input_scroll_x, line->input_display_width);
 
-        TRACE_LOG("Finished page-up repainting.\n");
-      }
-      else if ( (event_type == EVENT_WAS_CODE_PAGE_DOWN)
-          && (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) ) {
-        z_windows[0]->scrollback_top_line -= scroll_area_ysize;
-        screen_monospace_interface->copy_area(
-            z_windows[0]->ypos,
-            z_windows[0]->xpos,
-            z_windows[0]->ypos + scroll_area_ysize,
-            z_windows[0]->xpos,
-            z_windows[0]->ysize - scroll_area_ysize,
-            z_windows[0]->xsize);
-        screen_monospace_interface->clear_area(
-            z_windows[0]->xpos,
-            z_windows[0]->ypos
-            + (z_windows[0]->ysize - scroll_area_ysize),
-            screen_width,
-            scroll_area_ysize);
-        refresh_window0(
-            scroll_area_ysize,
-            1 + (z_windows[0]->ysize - scroll_area_ysize),
-            false);
-        TRACE_LOG("Finished page-down repainting.\n");
-      }
-
-      screen_monospace_interface->set_cursor_visibility(
-          z_windows[0]->scrollback_top_line > z_windows[0]->ysize
-          ? false : true);
+        draw_line_input(line);
 
-      screen_monospace_interface->update_screen();
-    }
-    else
-    {
-      if (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) {
-        erase_window(0);
-        z_windows[0]->scrollback_top_line = z_windows[0]->ysize;
-        refresh_window0(z_windows[0]->ysize, 1, false);
-        screen_monospace_interface->set_cursor_visibility(true);
+        refresh_cursor(active_z_window_id);
         screen_monospace_interface->update_screen();
       }
-
-      // Invalidate history from scrolling, since it will no longer be
-      // valid in case of new output.
-      if (history != NULL) {
-        TRACE_LOG("Destroying history output.\n");
-        destroy_history_output(history);
-        history = NULL;
-        current_history_screen_line = -1;
-        current_history_hit_top = false;
-      }
-
-      if (event_type == EVENT_WAS_INPUT)
+    }
+    else if (event_type == EVENT_WAS_CODE_BACKSPACE)
+    {
+      // We only have something to do if the cursor is not at the start of
+      // the input.
+      if (line->input_index > 0)
       {
-        if (input == Z_UCS_NEWLINE)
-        {
-          input_in_progress = false;
-        }
-        else if (input == 12)
+        TRACE_LOG("input_display_width: %d.\n", line->input_display_width);
+        TRACE_LOG("xpos: %d.\n", z_windows[active_z_window_id]->xpos);
+        TRACE_LOG("xcursorpos: %d.\n",
+            z_windows[active_z_window_id]->xcursorpos - 1);
+        TRACE_LOG("input_x: %d.\n", line->input_x);
+
+        input_column
+          = z_windows[active_z_window_id]->xpos
+          + z_windows[active_z_window_id]->xcursorpos - 1 - line->input_x;
+
+        input_line_delete(line->input_index - 1);
+        line->input_size--;
+        line->input_index--;
+
+        // Check if the cursor is on the leftmost input column.
+        if (input_column == 0)
         {
-          TRACE_LOG("Got CTRL-L.\n");
-          //erase_window(0);
-          //refresh_window0(z_windows[0]->ysize, 1, true);
-          //screen_monospace_interface->redraw_screen_from_scratch();
-          refresh_screen();
+          // In this case we don't have to do anything to correct the
+          // display, modifying the memory is enough.
+          line->input_scroll_x--;
         }
-        else if (input == 18)
-        {
-          TRACE_LOG("Got CTRL-R.\n");
-          new_monospace_screen_size(
-              screen_monospace_interface->get_screen_height(),
-              screen_monospace_interface->get_screen_width());
-        }
-        else if (
-            // Check if we have a valid input char.
-            (unicode_char_to_zscii_input_char(input) != 0xff)
-            &&
-            (
-             // We'll also only add new input if we're either not at the end
-             // of a filled input line ...
-             (input_size < maximum_length)
-             ||
-             // ... or if the cursor is left of the input end.
-             (input_index < input_size)
-            )
-            )
+        else
         {
-          TRACE_LOG("New ZSCII input char %d / z_ucs code %d.\n",
-              unicode_char_to_zscii_input_char(input), input);
+          // If we're at any point right of the leftmost column, we'll first
+          // move everthing right of the cursor on position to the left.
+          TRACE_LOG("Moving %d chars from %d/%d one column left.\n",
+              line->input_display_width - input_column,
+              line->input_x + input_column,
+              line->input_y);
 
-          TRACE_LOG("Input_buffer at %p (length %d): \"",
-              input_buffer, input_index);
-          TRACE_LOG_Z_UCS(input_buffer);
-          TRACE_LOG("\".\n");
+          shift_line_input(line,
+              input_column, line->input_display_width - input_column, -1);
+          draw_line_input(line);
 
-          TRACE_LOG("input_index: %d, input_size: %d, maximum_length: %d.\n",
-              input_index, input_size, maximum_length);
+          z_windows[active_z_window_id]->xcursorpos--;
 
-          if (input_index < input_size)
-          {
-            // In case we're not appending at the end of the input, we'll
-            // provide space for a new char in the input (and lose the rightmost
-            // char in case the input line is full):
-            memmove(
-                input_buffer + input_index + 1,
-                input_buffer + input_index,
-                sizeof(z_ucs) * (input_size - input_index + 1
-                  - (input_size < maximum_length ? 0 : 1)));
-
-            TRACE_LOG("%p, %p, %lu.\n",
-                input_buffer + input_index + 1,
-                input_buffer + input_index,
-                sizeof(z_ucs) * (input_size - input_index + 1
-                  - (input_size < maximum_length ? 0 : 1)));
-          }
-          else
-          {
-            input_buffer[input_index + 1] = 0;
-          }
+          refresh_cursor(active_z_window_id);
+          screen_monospace_interface->update_screen();
+        }
+      }
+    }
+    else if (event_type == EVENT_WAS_CODE_DELETE)
+    {
+      // We only have something to do if the cursor is not after the end of
+      // input.
+      if (line->input_index < line->input_size)
+      {
+        input_column
+          = z_windows[active_z_window_id]->xpos
+          + z_windows[active_z_window_id]->xcursorpos - 1 - line->input_x;
 
-          input_buffer[input_index] = input;
-          input_index++;
-
-          TRACE_LOG("fresh input_buffer (length %d): \"", input_index);
-          TRACE_LOG_Z_UCS(input_buffer);
-          TRACE_LOG("\".\n");
-
-          if (input_size < maximum_length)
-            input_size++;
-
-          TRACE_LOG("xcp %d, rm %d, xs: %d.\n",
-              z_windows[active_z_window_id]->xcursorpos,
-              z_windows[active_z_window_id]->rightmargin,
-              z_windows[active_z_window_id]->xsize);
-
-          if (z_windows[active_z_window_id]->xcursorpos
-              + z_windows[active_z_window_id]->rightmargin
-              == z_windows[active_z_window_id]->xsize) {
-            TRACE_LOG("Input at rightmost position.\n");
-            screen_monospace_interface->copy_area(
-                input_y, input_x,
-                input_y, input_x + 1,
-                1, input_display_width - 1);
-            input_scroll_x++;
-            char_buf[0] = Z_UCS_SPACE;
-            screen_monospace_interface->goto_yx(
-                input_y, input_x + input_display_width - 1);
-            screen_monospace_interface->z_ucs_output(char_buf);
-          }
-          else
-            z_windows[active_z_window_id]->xcursorpos++;
+        input_line_delete(line->input_index);
+        line->input_size--;
 
-          buf = 0;
-          TRACE_LOG("out:%d, %d, %d\n",
-              input_size, input_scroll_x, input_display_width);
+        TRACE_LOG("Moving %d chars from %d/%d one column left.\n",
+            line->input_display_width - input_column - 1,
+            line->input_x + input_column + 1,
+            line->input_y);
 
-          if (input_size - input_scroll_x >= input_display_width+1)
-          {
-            buf = input_buffer[input_scroll_x + input_display_width];
-            input_buffer[input_scroll_x + input_display_width] = 0;
-          }
+        shift_line_input(line,
+            input_column + 1, line->input_display_width - input_column - 1, -1);
 
-          screen_monospace_interface->goto_yx(input_y, input_x);
-          screen_monospace_interface->z_ucs_output(input_buffer+input_scroll_x);
-          if (buf != 0)
-            input_buffer[input_scroll_x + input_display_width] = buf;
+        TRACE_LOG("DEL: size:%d, index:%d, width:%d, input_scroll_x:%d.\n",
+            line->input_size, line->input_index, line->input_display_width,
+            line->input_scroll_x);
 
-          refresh_cursor(active_z_window_id);
-          screen_monospace_interface->update_screen();
-        }
+        // This fills the rightmost column either with a space or with
+        // input that has been right of the screen so far.
+        draw_line_input(line);
+
+        refresh_cursor(active_z_window_id);
+        screen_monospace_interface->update_screen();
       }
-      else if (event_type == EVENT_WAS_CODE_BACKSPACE)
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_LEFT)
+    {
+      if (line->input_index > 0)
       {
-        // We only have something to do if the cursor is not at the start of
-        // the input.
-        if (input_index > 0)
+        if (z_windows[active_z_window_id]->xpos
+            + z_windows[active_z_window_id]->xcursorpos - 1
+            > line->input_x)
         {
-          TRACE_LOG("input_display_width: %d.\n", input_display_width);
-          TRACE_LOG("xpos: %d.\n", z_windows[active_z_window_id]->xpos);
-          TRACE_LOG("xcursorpos: %d.\n",
-              z_windows[active_z_window_id]->xcursorpos - 1);
-          TRACE_LOG("input_x: %d.\n", input_x);
-
-          // We always have to move all chars from the cursor position onward
-          // one position to the left.
-          memmove(
-              input_buffer + input_index - 1,
-              input_buffer + input_index,
-              sizeof(z_ucs)*(input_size - input_index + 1));
-
-          input_size--;
-          input_index--;
-
-          // Check if the cursor is on the leftmost input column.
-          if (z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos - 1
-              == input_x)
-          {
-            // In this case we don't have to do anything to correct the
-            // display, modifying the memory is enough.
-            input_scroll_x--;
-          }
-          else
-          {
-            // If we're at any point right of the leftmost column, we'll first
-            // move everthing right of the cursor on position to the left.
-            TRACE_LOG("Moving %d chars from  %d/%d to %d/%d.\n",
-                input_display_width -
-                ((z_windows[active_z_window_id]->xpos
-                  + z_windows[active_z_window_id]->xcursorpos - 1) - input_x),
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos - 1,
-                input_y,
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos - 2,
-                input_y);
-
-            screen_monospace_interface->copy_area(
-                input_y,
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos - 2,
-                input_y,
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos - 1,
-                1,
-                input_display_width -
-                ((z_windows[active_z_window_id]->xpos
-                  + z_windows[active_z_window_id]->xcursorpos - 1) - input_x));
-
-            char_buf[0] = Z_UCS_SPACE;
-            screen_monospace_interface->goto_yx(
-                input_y, input_x + input_display_width - 1);
-            screen_monospace_interface->z_ucs_output(char_buf);
-
-            z_windows[active_z_window_id]->xcursorpos--;
-
-            refresh_cursor(active_z_window_id);
-            screen_monospace_interface->update_screen();
-          }
+          z_windows[active_z_window_id]->xcursorpos--;
         }
-      }
-      else if (event_type == EVENT_WAS_CODE_DELETE)
-      {
-        // We only have something to do if the cursor is not after the end of
-        // input.
-        if (input_index < input_size)
+        else
         {
-          // We always have to move all chars from the cursor position onward
-          // one position to the left.
-          memmove(
-              input_buffer + input_index,
-              input_buffer + input_index + 1,
-              sizeof(z_ucs)*(input_size - input_index));
-
-          input_size--;
-
-          TRACE_LOG("Moving %d chars from  %d/%d to %d/%d.\n",
-              input_display_width -
-              ((z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos) - input_x),
-              z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos,
-              input_y,
-              z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos - 1,
-              input_y);
-
-          screen_monospace_interface->copy_area(
-              input_y,
-              z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos - 1,
-              input_y,
-              z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos,
-              1,
-              input_display_width -
-              ((z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos) - input_x));
-
-          TRACE_LOG("DEL: size:%d, index:%d, width:%d, input_scroll_x:%d.\n",
-              input_size, input_index, input_display_width, input_scroll_x);
-          // Check whether we have to fill the rightmost column with a
-          // space, of if the input is longer than the screen and if we
-          // have to fill the column with user input.
-          char_buf[0]
-            = input_size - input_scroll_x >= input_display_width
-            ? input_buffer[input_scroll_x + input_display_width]
-            : Z_UCS_SPACE;
-
-          screen_monospace_interface->goto_yx(
-              input_y, input_x + input_display_width - 1);
-          screen_monospace_interface->z_ucs_output(char_buf);
-
-          refresh_cursor(active_z_window_id);
-          screen_monospace_interface->update_screen();
+          shift_line_input(line, 0, line->input_display_width - 1, 1);
+          line->input_scroll_x--;
+          draw_line_input(line);
         }
+
+        refresh_cursor(active_z_window_id);
+        screen_monospace_interface->update_screen();
+        line->input_index--;
       }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_LEFT)
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_RIGHT)
+    {
+      // Verify if we're at the end of input (plus one more char since
+      // the cursor must also be allowed behind the input for appending):
+      if (line->input_index < line->input_size)
       {
-        if (input_index > 0)
+        // Check if advancing the cursor right would move it behind the
+        // rightmost allowed input column.
+        if (z_windows[active_z_window_id]->xpos
+            + z_windows[active_z_window_id]->xcursorpos
+            < line->input_x + line->input_display_width)
         {
-          if (z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos - 1
-              > input_x)
-          {
-            z_windows[active_z_window_id]->xcursorpos--;
-            refresh_cursor(active_z_window_id);
-            screen_monospace_interface->update_screen();
-          }
-          else
-          {
-            screen_monospace_interface->copy_area(
-                input_y,
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos,
-                input_y,
-                z_windows[active_z_window_id]->xpos
-                + z_windows[active_z_window_id]->xcursorpos - 1,
-                1,
-                input_display_width - 1);
-
-            screen_monospace_interface->goto_yx(input_y, input_x);
-            char_buf[0] = input_buffer[input_scroll_x - 1];
-            input_scroll_x--;
-            screen_monospace_interface->z_ucs_output(char_buf);
-            screen_monospace_interface->goto_yx(input_y, input_x);
-            //refresh_cursor(active_z_window_id);
-            screen_monospace_interface->update_screen();
-          }
-
-          input_index--;
+          // In this case, the cursor is still left of the right border, so
+          // we can just move it left:
+          z_windows[active_z_window_id]->xcursorpos++;
         }
-      }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_RIGHT)
-      {
-        // Verify if we're at the end of input (plus one more char since
-        // the cursor must also be allowed behind the input for appending):
-        if (input_index < input_size)
+        else
         {
-          // Check if advancing the cursor right would move it behind the
-          // rightmost allowed input column.
-          if (z_windows[active_z_window_id]->xpos
-              + z_windows[active_z_window_id]->xcursorpos
-              < input_x + input_display_width)
-          {
-            // In this case, the cursor is still left of the right border, so
-            // we can just move it left:
-            z_windows[active_z_window_id]->xcursorpos++;
-            refresh_cursor(active_z_window_id);
-          }
-          else
-          {
-            // If the cursor moves behind the current rightmost position, we
-            // have to scroll the input line.
-            screen_monospace_interface->copy_area(
-                input_y,
-                input_x,
-                input_y,
-                input_x + 1,
-                1,
-                input_display_width - 1);
-
-            // Verify if the cusor is still over the input line or if it's
-            // now on the "append" column behind.
-            if (input_index == input_size - 1)
-            {
-              // In case we're at the end we have to fill the new, empty
-              // column with a space.
-              char_buf[0] = Z_UCS_SPACE;
-            }
-            else
-            {
-              // If the cursor is still over the input, we'll fill the
-              // rightmost column with appropriate char.
-              char_buf[0] = input_buffer[input_scroll_x + input_display_width];
-            }
-            // After determining how to fill the rightmost column, jump to
-            // the correct position on-screen, display the new char and
-            // re-position the cursor over the rightmost column.
-            screen_monospace_interface->goto_yx(input_y,
-                input_x + input_display_width - 1);
-            screen_monospace_interface->z_ucs_output(char_buf);
-            screen_monospace_interface->goto_yx(input_y,
-                input_x + input_display_width - 1);
-
-            input_scroll_x++;
-          }
-          screen_monospace_interface->update_screen();
-
-          // No matter whether we had to scroll or not, as long as we were
-          // not at the end of the input, the cursor was moved right, and thus
-          // the input index has to be altered.
-          input_index++;
+          // If the cursor moves behind the current rightmost position, we
+          // have to scroll the input line. The new rightmost column shows
+          // either the next char or, at the end of input, a space.
+          shift_line_input(line, 1, line->input_display_width - 1, -1);
+          line->input_scroll_x++;
+          draw_line_input(line);
         }
+        refresh_cursor(active_z_window_id);
+        screen_monospace_interface->update_screen();
+
+        // No matter whether we had to scroll or not, as long as we were
+        // not at the end of the input, the cursor was moved right, and thus
+        // the input index has to be altered.
+        line->input_index++;
       }
-      else if (
-          (disable_command_history == false)
+    }
+    else if (
+        (line->disable_command_history == false)
+        &&
+        (
+         (
+          (event_type == EVENT_WAS_CODE_CURSOR_UP)
           &&
-          (
-           (
-            (event_type == EVENT_WAS_CODE_CURSOR_UP)
-            &&
-            (cmd_history_index < get_number_of_stored_commands())
-           )
-           ||
-           (
-            (event_type == EVENT_WAS_CODE_CURSOR_DOWN)
-            &&
-            (cmd_history_index != 0)
-           )
-          )
+          (line->cmd_history_index < get_number_of_stored_commands())
          )
-      {
-        TRACE_LOG("old history index: %d.\n", cmd_history_index);
-
-        cmd_history_index += event_type == EVENT_WAS_CODE_CURSOR_UP ? 1 : -1;
-        cmd_history_ptr = get_command_from_history(cmd_history_index - 1);
-        TRACE_LOG("cmd_history_ptr: %p.\n", cmd_history_ptr);
-
-        if (cmd_history_index > 0)
-        {
-          input_size = strlen((char*)cmd_history_ptr);
-          if (input_size > input_display_width + 1)
-          {
-            input_scroll_x = input_size - input_display_width;
-            z_windows[active_z_window_id]->xcursorpos
-              = input_x + input_display_width;
-          }
-          else
-          {
-            input_scroll_x = 0;
-            z_windows[active_z_window_id]->xcursorpos = input_x + input_size;
-          }
-
-          input_index = input_size;
+         ||
+         (
+          (event_type == EVENT_WAS_CODE_CURSOR_DOWN)
+          &&
+          (line->cmd_history_index != 0)
+         )
+        )
+       )
+    {
+      TRACE_LOG("old history index: %d.\n", line->cmd_history_index);
 
-          for (i=0; i<=input_size; i++)
-            input_buffer[i] = zscii_input_char_to_z_ucs(*(cmd_history_ptr++));
+      line->cmd_history_index
+        += event_type == EVENT_WAS_CODE_CURSOR_UP ? 1 : -1;
+      cmd_history_ptr = get_command_from_history(line->cmd_history_index - 1);
+      TRACE_LOG("cmd_history_ptr: %p.\n", cmd_history_ptr);
 
-          TRACE_LOG("out:%d, %d, %d\n",
-              input_size, input_scroll_x, input_display_width);
+      input_line_reset(line->maximum_length);
 
-          if (input_size - input_scroll_x >= input_display_width+1)
-          {
-            buf = input_buffer[input_scroll_x + input_display_width];
-            input_buffer[input_scroll_x + input_display_width] = 0;
-          }
-          else
-            buf = 0;
+      if (line->cmd_history_index > 0)
+      {
+        for (i=0;
+            (cmd_history_ptr[i] != 0) && (i < line->maximum_length);
+            i++)
+          input_line_insert(i, zscii_input_char_to_z_ucs(cmd_history_ptr[i]));
+        line->input_size = input_line_get_length();
 
-          screen_monospace_interface->goto_yx(input_y, input_x);
-          screen_monospace_interface->z_ucs_output(
-              input_buffer + input_scroll_x);
-          if (buf != 0)
-            input_buffer[input_scroll_x + input_display_width] = buf;
-          clear_to_end_of_monospace_line();
+        if (line->input_size > line->input_display_width + 1)
+        {
+          line->input_scroll_x = line->input_size - line->input_display_width;
+          z_windows[active_z_window_id]->xcursorpos
+            = line->input_x + line->input_display_width;
         }
         else
         {
-          input_size = 0;
-          input_scroll_x = 0;
-          input_index = 0;
-          z_windows[active_z_window_id]->xcursorpos = input_x;
-          screen_monospace_interface->goto_yx(input_y, input_x);
-          clear_to_end_of_monospace_line();
+          line->input_scroll_x = 0;
+          z_windows[active_z_window_id]->xcursorpos
+            = line->input_x + line->input_size;
         }
 
-        refresh_cursor(active_z_window_id);
-        screen_monospace_interface->update_screen();
+        line->input_index = line->input_size;
+
+        TRACE_LOG("out:%d, %d, %d\n",
+            line->input_size, line->input_scroll_x, line->input_display_width);
       }
-      else if (event_type == EVENT_WAS_WINCH)
+      else
       {
-        TRACE_LOG("timeout.\n");
-        new_width = screen_monospace_interface->get_screen_width();
-        new_height = screen_monospace_interface->get_screen_height();
-        if ( (screen_height != new_height) || (screen_width != new_width) ) {
-          new_monospace_screen_size(
-              screen_monospace_interface->get_screen_height(),
-              screen_monospace_interface->get_screen_width());
-        }
+        line->input_size = 0;
+        line->input_scroll_x = 0;
+        line->input_index = 0;
+        z_windows[active_z_window_id]->xcursorpos = line->input_x;
       }
-      else if (event_type == EVENT_WAS_CODE_CTRL_A)
-      {
-        if (input_index > 0)
-        {
-          if (input_scroll_x > 0)
-          {
-            input_scroll_x  = 0;
-            index = input_display_width < input_size
-              ? input_display_width : input_size;
-            char_buf[0] = input_buffer[index];
-            input_buffer[index] = 0;
-            screen_monospace_interface->goto_yx(input_y, input_x);
-            screen_monospace_interface->z_ucs_output(input_buffer);
-            input_buffer[index] = char_buf[0];
-          }
 
-          z_windows[active_z_window_id]->xcursorpos = input_x;
-          input_index = 0;
-          refresh_cursor(active_z_window_id);
-          screen_monospace_interface->update_screen();
-        }
+      // Commands from the history often share their beginning, so only
+      // the differing part has to be drawn.
+      draw_line_input(line);
+
+      refresh_cursor(active_z_window_id);
+      screen_monospace_interface->update_screen();
+    }
+    else if (event_type == EVENT_WAS_WINCH)
+    {
+      TRACE_LOG("timeout.\n");
+      new_width = screen_monospace_interface->get_screen_width();
+      new_height = screen_monospace_interface->get_screen_height();
+      if ( (resize_pending == true)
+          || (screen_height != new_height) || (screen_width != new_width) ) {
+        new_monospace_screen_size(
+            screen_monospace_interface->get_screen_height(),
+            screen_monospace_interface->get_screen_width());
       }
-      else if (event_type == EVENT_WAS_CODE_CTRL_E)
+    }
+    else if (event_type == EVENT_WAS_CODE_CTRL_A)
+    {
+      if (line->input_index > 0)
       {
-        TRACE_LOG("input_size:%d, input_display_width:%d.\n",
-            input_size, input_display_width);
-
-        if (input_size > input_display_width - 1)
+        if (line->input_scroll_x > 0)
         {
-          input_scroll_x = input_size - input_display_width + 1;
-          screen_monospace_interface->goto_yx(input_y, input_x);
-          screen_monospace_interface->z_ucs_output(input_buffer+input_scroll_x);
-          clear_to_end_of_monospace_line();
-          z_windows[active_z_window_id]->xcursorpos
-            = input_x + input_display_width - 1;
+          line->input_scroll_x  = 0;
+          draw_line_input(line);
         }
-        else
-          z_windows[active_z_window_id]->xcursorpos = input_x + input_size;
 
-        input_index = input_size;
+        z_windows[active_z_window_id]->xcursorpos = line->input_x;
+        line->input_index = 0;
         refresh_cursor(active_z_window_id);
         screen_monospace_interface->update_screen();
       }
-      else if (event_type == EVENT_WAS_CODE_ESC)
+    }
+    else if (event_type == EVENT_WAS_CODE_CTRL_E)
+    {
+      TRACE_LOG("input_size:%d, input_display_width:%d.\n",
+          line->input_size, line->input_display_width);
+
+      if (line->input_size > line->input_display_width - 1)
+      {
+        line->input_scroll_x = line->input_size - line->input_display_width + 1;
+        draw_line_input(line);
+        z_windows[active_z_window_id]->xcursorpos
+          = line->input_x + line->input_display_width - 1;
+      }
+      else
+        z_windows[active_z_window_id]->xcursorpos
+          = line->input_x + line->input_size;
+
+      line->input_index = line->input_size;
+      refresh_cursor(active_z_window_id);
+      screen_monospace_interface->update_screen();
+    }
+    else if (event_type == EVENT_WAS_CODE_ESC)
+    {
+      if (line->return_on_escape == true)
       {
-        if (return_on_escape == true)
-        {
-          input_in_progress = false;
-          input_size = -2;
-        }
+        line->input_in_progress = false;
+        line->input_size = -2;
       }
     }
+  }
 
-    TRACE_LOG("readline-ycursorpos: %d.\n", z_windows[0]->ycursorpos);
+  TRACE_LOG("readline-ycursorpos: %d.\n", z_windows[0]->ycursorpos);
+
+  TRACE_LOG("input_size:%d, input_index:%d, input_scroll_x:%d\n",
+      line->input_size, line->input_index, line->input_scroll_x);
+}
+
+
+// Removes the input line from the screen and stores the input in "dest".
+static int16_t end_line_input(struct line_input *line) {
+  int i;
 
-    TRACE_LOG("current input_buffer: \"");
-    TRACE_LOG_Z_UCS(input_buffer);
-    TRACE_LOG("\".\n");
-    TRACE_LOG("input_scroll_x:%d\n", input_scroll_x);
-  }
   TRACE_LOG("x-readline-ycursorpos: %d.\n", z_windows[0]->ycursorpos);
 
-  screen_monospace_interface->goto_yx(input_y, input_x);
+  screen_monospace_interface->goto_yx(line->input_y, line->input_x);
   clear_to_end_of_monospace_line();
   z_windows[active_z_window_id]->xcursorpos
-    = input_x - (z_windows[active_z_window_id]->xpos - 1);
+    = line->input_x - (z_windows[active_z_window_id]->xpos - 1);
   refresh_cursor(active_z_window_id);
 
   input_line_on_screen = false;
 
-  for (i=0; i<input_size; i++)
+  for (i=0; i<line->input_size; i++)
   {
-    TRACE_LOG("converting:%c\n", input_buffer[i]);
-    dest[i] = unicode_char_to_zscii_input_char(input_buffer[i]);
+    TRACE_LOG("converting:%c\n", input_line_get_char(i));
+    line->dest[i] = unicode_char_to_zscii_input_char(input_line_get_char(i));
   }
 
-  TRACE_LOG("len:%d\n", input_size);
+  TRACE_LOG("len:%d\n", line->input_size);
   TRACE_LOG("after-readline-ycursorpos: %d.\n", z_windows[0]->ycursorpos);
-  return input_size;
+  TRACE_EVENT(TRACE_EVENT_READ_LINE_END, line->input_size, 0, 0);
+  return line->input_size;
 }
 
 
-static int read_char(uint16_t tenth_seconds, uint32_t verification_routine,
-    int *tenth_seconds_elapsed)
+// NOTE: Keep in mind that the verification routine may recursively
+// call a read (Border Zone does this).
+// This function reads a maximum of maximum_length characters from stdin
+// to dest. The number of characters read is returned. The input is NOT
+// terminated with a newline (in order to conform to V5+ games).
+// Returns -1 when int routine returns != 0
+// Returns -2 when user ended input with ESC
+static int16_t read_line(zscii *dest, uint16_t maximum_length,
+    uint16_t tenth_seconds, uint32_t verification_routine,
+    uint8_t preloaded_input, int *tenth_seconds_elapsed,
+    bool disable_command_history, bool return_on_escape)
 {
-  bool input_in_progress = true;
-  int event_type;
-  int timeout_millis = -1;
+  struct line_input line_input;
+  struct line_input *outer_line_input = current_line_input;
+  bool outer_input_line_on_screen = input_line_on_screen;
+  struct input_line_state outer_input_line;
   z_ucs input;
+  int event_type;
+  int16_t result;
+
+  // A read from within the verification routine of another one replaces
+  // the outer line's text, which is restored once it's finished.
+  if (outer_line_input != NULL)
+    input_line_save(&outer_input_line);
+
+  begin_line_input(&line_input, dest, maximum_length, tenth_seconds,
+      verification_routine, preloaded_input, tenth_seconds_elapsed,
+      disable_command_history, return_on_escape);
+
+  while (line_input.input_in_progress == true)
+  {
+    event_type = get_next_input_event(
+        &input, get_timed_input_timeout(&line_input.timed_input));
+    process_line_input_event(&line_input, event_type, input);
+  }
+
+  result = end_line_input(&line_input);
+
+  if (outer_line_input != NULL)
+    input_line_restore(&outer_input_line);
+  current_line_input = outer_line_input;
+  input_line_on_screen = outer_input_line_on_screen;
+
+  return result;
+}
+
+
+// State of a character input in progress, see "struct line_input".
+struct char_input {
+  uint32_t verification_routine;
+  int *tenth_seconds_elapsed;
+  bool input_in_progress;
   zscii result;
-  //int i;
-  int current_tenth_seconds = 0;
-  int timed_routine_retval;
+  struct timed_input timed_input;
+};
+
+
+static void begin_char_input(struct char_input *character,
+    uint16_t tenth_seconds, uint32_t verification_routine,
+    int *tenth_seconds_elapsed) {
   int i;
-  int scroll_area_ysize;
-  bool redraw_result;
+
+  character->verification_routine = verification_routine;
+  character->tenth_seconds_elapsed = tenth_seconds_elapsed;
+  character->input_in_progress = true;
+  character->result = 0;
 
   flush_all_buffered_windows();
   for (i=0; i<nof_active_z_windows; i++)
@@ -2866,342 +3234,299 @@ static int read_char(uint16_t tenth_seconds, uint32_t verification_routine,
 
   screen_monospace_interface->update_screen();
 
-  if ((tenth_seconds != 0) && (verification_routine != 0))
-  {
-    TRACE_LOG("timed input in read_line every %d tenth seconds.\n",
-        tenth_seconds);
+  start_timed_input(&character->timed_input,
+      tenth_seconds, verification_routine, tenth_seconds_elapsed);
+}
 
-    timed_input_active = true;
 
-    timeout_millis = (is_timed_keyboard_input_available() == true ? 100 : 0);
+// Processes a single event, "input_in_progress" is set to false once the
+// input is complete.
+static void process_char_input_event(struct char_input *character,
+    int event_type, z_ucs input) {
+  int timed_routine_retval;
 
-    if (tenth_seconds_elapsed != NULL)
-      *tenth_seconds_elapsed = 0;
+  if (
+      (event_type == EVENT_WAS_CODE_PAGE_UP)
+      || (event_type == EVENT_WAS_CODE_PAGE_DOWN)
+     ) {
+    scroll_back(event_type);
   }
   else
-    timed_input_active = false;
-
-  while (input_in_progress == true)
   {
-    event_type = screen_monospace_interface->get_next_event(&input,
-        timeout_millis);
-
-    if (
-        (event_type == EVENT_WAS_CODE_PAGE_UP)
-        || (event_type == EVENT_WAS_CODE_PAGE_DOWN)
-       ) {
-      scroll_area_ysize = z_windows[0]->ysize / 2;
-      TRACE_LOG("scroll_area_ysize: %d.\n", scroll_area_ysize);
-      // "scroll_area_ysize" denotes the area which we're refreshing, not(!)
-      // the area we're copying on-screen. Example: In case the screen has
-      // height 29, we're copying 15 lines of existing screen contents and
-      // refresh the remaining 14 lines.
-
-      if ( (event_type == EVENT_WAS_CODE_PAGE_UP)
-          && (current_history_hit_top == false) ) {
-        z_windows[0]->scrollback_top_line += scroll_area_ysize;
-        TRACE_LOG("scrollback_top_line: %d.\n",
-            z_windows[0]->scrollback_top_line);
-
-        if (z_windows[0]->ycursorpos != z_windows[0]->ysize) {
-          TRACE_LOG("Cursor not at bottom, have to redraw everything.\n");
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              z_windows[0]->ysize);
-          redraw_result = refresh_window0(
-              z_windows[0]->ysize,
-              1,
-              true);
-        }
-        else {
-          TRACE_LOG("Cursor at bottom, copying and refreshing half screen.\n");
-          screen_monospace_interface->copy_area(
-              z_windows[0]->ypos + scroll_area_ysize,
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              z_windows[0]->xpos,
-              z_windows[0]->ysize - scroll_area_ysize,
-              z_windows[0]->xsize);
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              scroll_area_ysize);
-          redraw_result = refresh_window0(
-              scroll_area_ysize,
-              1,
-              false);
-        }
-
-        if (redraw_result == false) {
-          TRACE_LOG("Area to display outside history bounds.\n");
-          z_windows[0]->scrollback_top_line -= scroll_area_ysize;
-          // Clear window before redraw: Although we've already cleared
-          // window 0 above and the return code of refresh_window0 shows
-          // there was no output in the meantime, the "copy_area" above
-          // may have written to areas which will be left empty by the
-          // "refresh_window0" further below.
-          screen_monospace_interface->clear_area(
-              z_windows[0]->xpos,
-              z_windows[0]->ypos,
-              screen_width,
-              z_windows[0]->ysize);
-          refresh_window0(
-              z_windows[0]->ysize,
-              1,
-              true);
-        }
+    leave_scrollback();
 
-        TRACE_LOG("Finished page-up repainting.\n");
-      }
-      else if ( (event_type == EVENT_WAS_CODE_PAGE_DOWN)
-          && (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) ) {
-        z_windows[0]->scrollback_top_line -= scroll_area_ysize;
-        screen_monospace_interface->copy_area(
-            z_windows[0]->ypos,
-            z_windows[0]->xpos,
-            z_windows[0]->ypos + scroll_area_ysize,
-            z_windows[0]->xpos,
-            z_windows[0]->ysize - scroll_area_ysize,
-            z_windows[0]->xsize);
-        screen_monospace_interface->clear_area(
-            z_windows[0]->xpos,
-            z_windows[0]->ypos
-            + (z_windows[0]->ysize - scroll_area_ysize),
-            screen_width,
-            scroll_area_ysize);
-        refresh_window0(
-            scroll_area_ysize,
-            1 + (z_windows[0]->ysize - scroll_area_ysize),
-            false);
-        TRACE_LOG("Finished page-down repainting.\n");
-      }
-
-      screen_monospace_interface->set_cursor_visibility(
-          z_windows[0]->scrollback_top_line > z_windows[0]->ysize
-          ? false : true);
-
-      screen_monospace_interface->update_screen();
-    }
-    else
+    if (event_type == EVENT_WAS_INPUT)
     {
-      if (z_windows[0]->scrollback_top_line > z_windows[0]->ysize) {
-        erase_window(0);
-        z_windows[0]->scrollback_top_line = z_windows[0]->ysize;
-        refresh_window0(z_windows[0]->ysize, 1, false);
-        screen_monospace_interface->set_cursor_visibility(true);
-        screen_monospace_interface->update_screen();
+      if (input == 12)
+      {
+        TRACE_LOG("Got CTRL-L.\n");
+        //erase_window(0);
+        //refresh_window0(z_windows[0]->ysize, 1, true);
+        //screen_monospace_interface->redraw_screen_from_scratch();
+        refresh_screen();
       }
+      else
+      {
+        character->result = unicode_char_to_zscii_input_char(input);
 
-      // Invalidate history from scrolling, since it will no longer be
-      // valid in case of new output.
-      if (history != NULL) {
-        TRACE_LOG("Destroying history output.\n");
-        destroy_history_output(history);
-        history = NULL;
-        current_history_screen_line = -1;
-        current_history_hit_top = false;
+        if (character->result != 0xff)
+          character->input_in_progress = false;
       }
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_UP)
+    {
+      character->result = 129;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_DOWN)
+    {
+      character->result = 130;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_LEFT)
+    {
+      character->result = 131;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_CODE_CURSOR_RIGHT)
+    {
+      character->result = 132;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_CODE_BACKSPACE)
+    {
+      character->result = 8;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_CODE_DELETE)
+    {
+      character->result = 127;
+      character->input_in_progress = false;
+    }
+    else if (event_type == EVENT_WAS_TIMEOUT)
+    {
+      TRACE_LOG("timeout found.\n");
 
-      if (event_type == EVENT_WAS_INPUT)
+      if (character->timed_input.active == true)
       {
-        if (input == 12)
-        {
-          TRACE_LOG("Got CTRL-L.\n");
-          //erase_window(0);
-          //refresh_window0(z_windows[0]->ysize, 1, true);
-          //screen_monospace_interface->redraw_screen_from_scratch();
-          refresh_screen();
-        }
-        else
+        if (is_timed_input_due(&character->timed_input,
+              character->tenth_seconds_elapsed) == true)
         {
-          result = unicode_char_to_zscii_input_char(input);
-
-          if (result != 0xff)
-            input_in_progress = false;
-        }
-      }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_UP)
-      {
-        result = 129;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_DOWN)
-      {
-        result = 130;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_LEFT)
-      {
-        result = 131;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_CODE_CURSOR_RIGHT)
-      {
-        result = 132;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_CODE_BACKSPACE)
-      {
-        result = 8;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_CODE_DELETE)
-      {
-        result = 127;
-        input_in_progress = false;
-      }
-      else if (event_type == EVENT_WAS_TIMEOUT)
-      {
-        TRACE_LOG("timeout found.\n");
+          stream_output_has_occured = false;
 
-        if (timed_input_active == true)
-        {
-          current_tenth_seconds++;
-          if (tenth_seconds_elapsed != NULL)
-            (*tenth_seconds_elapsed)++;
+          TRACE_LOG("calling timed-input-routine at %x.\n",
+              character->verification_routine);
+          timed_routine_retval
+            = interpret_from_call(character->verification_routine);
+          TRACE_LOG("timed-input-routine finished.\n");
 
-          if (current_tenth_seconds == tenth_seconds)
+          if (terminate_interpreter != INTERPRETER_QUIT_NONE)
           {
-            current_tenth_seconds = 0;
-            stream_output_has_occured = false;
-
-            TRACE_LOG("calling timed-input-routine at %x.\n",
-                verification_routine);
-            timed_routine_retval = interpret_from_call(verification_routine);
-            TRACE_LOG("timed-input-routine finished.\n");
-
-            if (terminate_interpreter != INTERPRETER_QUIT_NONE)
+            TRACE_LOG("Quitting after verification.\n");
+            character->input_in_progress = false;
+            character->result = 0;
+          }
+          else
+          {
+            if (stream_output_has_occured == true)
             {
-              TRACE_LOG("Quitting after verification.\n");
-              input_in_progress = false;
-              result = 0;
+              flush_all_buffered_windows();
+              screen_monospace_interface->update_screen();
             }
-            else
+
+            if (timed_routine_retval != 0)
             {
-              if (stream_output_has_occured == true)
-              {
-                flush_all_buffered_windows();
-                screen_monospace_interface->update_screen();
-              }
-
-              if (timed_routine_retval != 0)
-              {
-                input_in_progress = false;
-                result = 0;
-              }
+              character->input_in_progress = false;
+              character->result = 0;
             }
           }
         }
       }
-      else if (event_type == EVENT_WAS_WINCH)
-      {
-        TRACE_LOG("timeout.\n");
-        new_monospace_screen_size(
-            screen_monospace_interface->get_screen_height(),
-            screen_monospace_interface->get_screen_width());
-      }
+    }
+    else if (event_type == EVENT_WAS_WINCH)
+    {
+      TRACE_LOG("timeout.\n");
+      new_monospace_screen_size(
+          screen_monospace_interface->get_screen_height(),
+          screen_monospace_interface->get_screen_width());
     }
   }
+}
 
-  return result;
+
+static int read_char(uint16_t tenth_seconds, uint32_t verification_routine,
+    int *tenth_seconds_elapsed)
+{
+  struct char_input character;
+  z_ucs input;
+  int event_type;
+
+  begin_char_input(&character,
+      tenth_seconds, verification_routine, tenth_seconds_elapsed);
+
+  while (character.input_in_progress == true)
+  {
+    event_type = get_next_input_event(
+        &input, get_timed_input_timeout(&character.timed_input));
+    process_char_input_event(&character, event_type, input);
+  }
+
+  return character.result;
+}
+
+
+static bool status_room_description_changed(z_ucs *room_description) {
+  z_ucs *ptr = last_status_room_description;
+
+  if (ptr == NULL)
+    return true;
+
+  while ( (*room_description != 0) && (*room_description == *ptr) ) {
+    room_description++;
+    ptr++;
+  }
+
+  return *room_description != *ptr;
+}
+
+
+// Builds the complete status line in "new_status_line". Column 1 holds a
+// space, followed by the room description and the right side, which ends
+// with another space in the last column.
+static void build_status_line(z_ucs *room_description, int status_line_mode,
+    int16_t parameter1, int16_t parameter2) {
+  z_ucs rightside_buf_zucs[libmonospaceif_right_status_min_size + 12];
+  char latin1_buf[14];
+  z_ucs *ptr;
+  int room_desc_space, rightside_start, i;
+
+  for (i=0; i<status_line_width; i++)
+    new_status_line[i] = Z_UCS_SPACE;
+  new_status_line[status_line_width] = 0;
+
+  if (status_line_mode == SCORE_MODE_SCORE_AND_TURN) {
+    ptr = z_ucs_cpy(rightside_buf_zucs, libmonospaceif_score_string);
+    snprintf(latin1_buf, sizeof(latin1_buf), ": %d  ", parameter1);
+    ptr = z_ucs_cat_latin1(ptr, latin1_buf);
+    ptr = z_ucs_cat(ptr, libmonospaceif_turns_string);
+    snprintf(latin1_buf, sizeof(latin1_buf), ": %d", parameter2);
+    ptr = z_ucs_cat_latin1(ptr, latin1_buf);
+    rightside_start = status_line_width - (z_ucs_len(rightside_buf_zucs) + 1);
+    room_desc_space = rightside_start - 3;
+  }
+  else if (status_line_mode == SCORE_MODE_TIME) {
+    snprintf(latin1_buf, sizeof(latin1_buf), "%02d:%02d",
+        parameter1, parameter2);
+    latin1_string_to_zucs_string(rightside_buf_zucs, latin1_buf, 8);
+    rightside_start = status_line_width - 6;
+    room_desc_space = status_line_width - 8;
+  }
+  else {
+    rightside_buf_zucs[0] = 0;
+    rightside_start = status_line_width;
+    room_desc_space = status_line_width - 2;
+  }
+
+  for (i=0;
+      (room_description[i] != 0) && (i < room_desc_space)
+      && (i + 1 < status_line_width);
+      i++)
+    new_status_line[i + 1] = room_description[i];
+
+  for (i=0;
+      (rightside_buf_zucs[i] != 0) && (rightside_start + i < status_line_width);
+      i++)
+    if (rightside_start + i >= 0)
+      new_status_line[rightside_start + i] = rightside_buf_zucs[i];
 }
 
 
+// The status line currently on screen is kept along with the values it was
+// built from. Unchanged values need no output at all, otherwise only the
+// segment from the first to the last changed column is rewritten.
 static void show_status(z_ucs *room_description, int status_line_mode,
     int16_t parameter1, int16_t parameter2)
 {
   int desc_len = z_ucs_len(room_description);
-  int rightside_length, room_desc_space;
-  z_ucs rightside_buf_zucs[libmonospaceif_right_status_min_size + 12];
-  z_ucs buf = 0;
-  z_ucs *ptr;
-  static char latin1_buf1[14];
-  static char latin1_buf2[9];
-  int last_active_z_window_id;
+  int width, first, last, last_active_z_window_id;
+  z_ucs *swap_buf;
 
   TRACE_LOG("statusline: \"");
   TRACE_LOG_Z_UCS(room_description);
   TRACE_LOG("\".\n");
 
-  TRACE_LOG("statusline-xsize: %d, screen:%d.\n",
-      z_windows[statusline_window_id]->xsize, screen_width);
-
-  if (statusline_window_id > 0) {
-    last_active_z_window_id = active_z_window_id;
-    switch_to_window(statusline_window_id);
-    erase_window(statusline_window_id);
-
-    z_windows[statusline_window_id]->ycursorpos = 1;
-    z_windows[statusline_window_id]->xcursorpos = 1;
-    refresh_cursor(statusline_window_id);
-    z_ucs_output(space_string);
-
-    if (status_line_mode == SCORE_MODE_SCORE_AND_TURN) {
-      sprintf(latin1_buf1, ": %d  ", parameter1);
-      sprintf(latin1_buf2, ": %d", parameter2);
-
-      ptr = z_ucs_cpy(rightside_buf_zucs, libmonospaceif_score_string);
-      ptr = z_ucs_cat_latin1(ptr, latin1_buf1);
-      ptr = z_ucs_cat(ptr, libmonospaceif_turns_string);
-      ptr = z_ucs_cat_latin1(ptr, latin1_buf2);
-      rightside_length = z_ucs_len(rightside_buf_zucs) + 1;
-      TRACE_LOG("rightside_length: %d.\n", rightside_length);
-
-      room_desc_space
-        = z_windows[statusline_window_id]->xsize - rightside_length - 3;
-
-      if (room_desc_space < desc_len) {
-        buf = room_description[room_desc_space];
-        room_description[room_desc_space] = 0;
-      }
+  if (statusline_window_id <= 0)
+    return;
 
-      z_ucs_output(room_description);
+  width = z_windows[statusline_window_id]->xsize;
 
-      while (z_windows[statusline_window_id]->xcursorpos
-          < z_windows[statusline_window_id]->xsize - rightside_length + 1) {
-        z_ucs_output(space_string);
-      }
+  TRACE_LOG("statusline-xsize: %d, screen:%d.\n", width, screen_width);
 
-      z_windows[statusline_window_id]->xcursorpos
-        = z_windows[statusline_window_id]->xsize - rightside_length + 1;
-      refresh_cursor(statusline_window_id);
+  if ( (status_line_valid == true)
+      && (width == status_line_width)
+      && (status_line_mode == last_status_line_mode)
+      && (parameter1 == last_status_parameter1)
+      && (parameter2 == last_status_parameter2)
+      && (status_room_description_changed(room_description) == false) ) {
+    TRACE_LOG("Status line unchanged.\n");
+    return;
+  }
 
-    }
-    else if (status_line_mode == SCORE_MODE_TIME) {
-      room_desc_space = z_windows[statusline_window_id]->xsize - 8;
+  if (width != status_line_width) {
+    status_line = fizmo_realloc(status_line, sizeof(z_ucs) * (width + 1));
+    new_status_line
+      = fizmo_realloc(new_status_line, sizeof(z_ucs) * (width + 1));
+    status_line_width = width;
+    status_line_valid = false;
+  }
 
-      if (room_desc_space < desc_len) {
-        buf = room_description[room_desc_space];
-        room_description[room_desc_space] = 0;
-      }
+  if (desc_len + 1 > last_status_room_description_size) {
+    last_status_room_description_size = desc_len + 1;
+    last_status_room_description = fizmo_realloc(
+        last_status_room_description,
+        sizeof(z_ucs) * last_status_room_description_size);
+  }
+  z_ucs_cpy(last_status_room_description, room_description);
+  last_status_line_mode = status_line_mode;
+  last_status_parameter1 = parameter1;
+  last_status_parameter2 = parameter2;
 
-      z_ucs_output(room_description);
+  build_status_line(
+      room_description, status_line_mode, parameter1, parameter2);
 
-      while (z_windows[statusline_window_id]->xcursorpos
-          < z_windows[statusline_window_id]->xsize - 5) {
-        z_ucs_output(space_string);
-      }
+  first = 0;
+  last = status_line_width - 1;
+  if (status_line_valid == true) {
+    while ( (first <= last) && (new_status_line[first] == status_line[first]) )
+      first++;
+    while ( (last >= first) && (new_status_line[last] == status_line[last]) )
+      last--;
+  }
 
-      z_windows[statusline_window_id]->xcursorpos
-        = z_windows[statusline_window_id]->xsize - 5;
-      refresh_cursor(statusline_window_id);
+  if (first <= last) {
+    TRACE_LOG("Rewriting status line from column %d to %d.\n",
+        first + 1, last + 1);
 
-      sprintf(latin1_buf1, "%02d:%02d", parameter1, parameter2);
-      latin1_string_to_zucs_string(rightside_buf_zucs, latin1_buf1, 8);
-    }
+    last_active_z_window_id = active_z_window_id;
+    switch_to_window(statusline_window_id);
 
-    z_ucs_output(rightside_buf_zucs);
-    z_ucs_output(space_string);
+    z_windows[statusline_window_id]->ycursorpos = 1;
+    z_windows[statusline_window_id]->xcursorpos = first + 1;
+    refresh_cursor(statusline_window_id);
 
-    if (buf != 0) {
-      room_description[room_desc_space] = buf;
-    }
+    update_output_colours(statusline_window_id);
+    update_output_text_style(statusline_window_id);
+    z_ucs_span_output(screen_monospace_interface,
+        new_status_line + first, last - first + 1);
+    z_windows[statusline_window_id]->xcursorpos = last + 2;
 
     switch_to_window(last_active_z_window_id);
   }
+
+  swap_buf = status_line;
+  status_line = new_status_line;
+  new_status_line = swap_buf;
+  status_line_valid = true;
 }
 
 
@@ -3324,6 +3649,9 @@ static void game_was_restored_and_history_modified()
 
   if (interface_open == true) {
     flush_all_buffered_windows();
+    paragraph_cache_invalidate();
+    scrollback_index_invalidate();
+    upper_window_cache_invalidate();
     z_windows[0]->scrollback_top_line = z_windows[0]->ysize;
     //screen_monospace_interface->update_screen();
     screen_monospace_interface->clear_area(
@@ -3333,17 +3661,14 @@ static void game_was_restored_and_history_modified()
         z_windows[0]->ysize);
     //input_line_on_screen_buf = input_line_on_screen;
     //input_line_on_screen = true;
+    // The history output's position may point into the replaced history.
+    discard_output_history();
     refresh_window0(z_windows[0]->ysize, 1, true);
-    if (history != NULL) {
-      TRACE_LOG("Destroying history output.\n");
-      destroy_history_output(history);
-      history = NULL;
-      current_history_hit_top = false;
-    }
     z_windows[0]->ycursorpos = z_windows[0]->ysize;
     z_windows[0]->xcursorpos = z_windows[0]->leftmargin + 1;
     //refresh_cursor(0);
-    TRACE_LOG("restore-y: %d\n", *current_input_y);
+    TRACE_LOG("restore-y: %d\n",
+        current_line_input != NULL ? current_line_input->input_y : -1);
     //input_line_on_screen = input_line_on_screen_buf;
   }
 }
@@ -3482,9 +3807,64 @@ void set_custom_right_monospace_margin(int width)
 
 
 // This function will redraw the screen on a resize.
+// Resizing the screen means redrawing everything, so the new size is only
+// recorded here. It's applied when the library waits for input next, see
+// "get_next_input_event".
 void new_monospace_screen_size(int newysize, int newxsize)
+{
+  if ( (newysize < 1) || (newxsize < 1) )
+    return;
+
+  TRACE_LOG("Recording new screen size %d*%d.\n", newxsize, newysize);
+
+  pending_screen_height = newysize;
+  pending_screen_width = newxsize;
+  resize_pending = true;
+}
+
+
+// Called after a change of the screen height only. Since all line breaks
+// stay the same, the contents of window 0 remain anchored at its bottom
+// and only the rows exposed have to be drawn from the history. Only used
+// for screens reporting "keeps_contents_on_resize".
+static void shift_window0_rows(int dy) {
+  int top = z_windows[0]->ypos;
+  int bottom = z_windows[0]->ypos + z_windows[0]->ysize - 1;
+  int xcursorpos = z_windows[0]->xcursorpos;
+  int nof_exposed_rows = dy > 0 ? dy : -dy;
+  int first_exposed_row = dy > 0 ? top : bottom - nof_exposed_rows + 1;
+
+  TRACE_LOG("Shifting window 0 by %d rows, refreshing %d from %d.\n",
+      dy, nof_exposed_rows, first_exposed_row);
+
+  if (scroll_window_rows(0, top, bottom, -dy) == false)
+    screen_monospace_interface->clear_area(
+        z_windows[0]->xpos,
+        first_exposed_row,
+        screen_width,
+        nof_exposed_rows);
+
+  refresh_window0(nof_exposed_rows, first_exposed_row - top + 1, true);
+
+  // In case the bottom row wasn't refreshed, the cursor position found
+  // by "refresh_window0" is meaningless.
+  if (input_line_on_screen == false) {
+    z_windows[0]->ycursorpos = z_windows[0]->ysize;
+    z_windows[0]->xcursorpos = xcursorpos;
+  }
+
+  update_output_colours(0);
+  update_output_text_style(0);
+  refresh_cursor(0);
+  screen_monospace_interface->update_screen();
+}
+
+
+static void resize_screen(int newysize, int newxsize)
 {
   int i, dy, status_offset = statusline_window_id > 0 ? 1 : 0;
+  int old_line_width, old_window0_ypos, old_window0_ysize, old_window1_ysize;
+  bool height_only;
   //int consecutive_lines_buffer[nof_active_z_windows];
 
   if ( (newysize < 1) || (newxsize < 1) )
@@ -3497,12 +3877,29 @@ void new_monospace_screen_size(int newysize, int newxsize)
   */
 
   dy = newysize - screen_height;
+  old_line_width = get_window0_line_width();
+  old_window0_ypos = z_windows[0]->ypos;
+  old_window0_ysize = z_windows[0]->ysize;
+  old_window1_ysize = z_windows[1]->ysize;
+
+  // Shifting the contents only works if window 0 shows the bottom of the
+  // history and nothing but its height changes.
+  height_only
+    = ( (ver != 6)
+        && (dy != 0)
+        && (newxsize == screen_width)
+        && (z_windows[0]->scrollback_top_line == z_windows[0]->ysize)
+        && (z_windows[0]->ycursorpos == z_windows[0]->ysize) )
+    ? true : false;
 
   screen_width = newxsize;
   screen_height = newysize;
 
   fizmo_new_screen_size(screen_width, screen_height);
 
+  if (shadow_grid_active == true)
+    shadow_grid_resize(screen_height, screen_width);
+
   TRACE_LOG("new monospace-window-size: %d*%d.\n",
       screen_width, screen_height);
 
@@ -3579,6 +3976,27 @@ void new_monospace_screen_size(int newysize, int newxsize)
       z_windows[i]->xcursorpos = z_windows[i]->xsize;
   }
 
+  // Paragraph heights and the scrollback index are kept per line width,
+  // so that switching back to a recent width doesn't have to measure
+  // everything again. Both are keyed by the history generation as well,
+  // so history positions reused in the meantime never match.
+
+  // The block buffer has been resized along with the screen.
+  upper_window_cache_invalidate();
+
+  if ( (height_only == true)
+      && (screen_monospace_interface->keeps_contents_on_resize != NULL)
+      && (screen_monospace_interface->keeps_contents_on_resize() == true)
+      && (get_window0_line_width() == old_line_width)
+      && (z_windows[1]->ysize == old_window1_ysize)
+      && (z_windows[0]->ypos == old_window0_ypos)
+      && (z_windows[0]->ysize == old_window0_ysize + dy)
+      && (z_windows[0]->ysize > (dy > 0 ? dy : -dy)) ) {
+    shift_window0_rows(dy);
+    return;
+  }
+
+  monospace_stats.resize_redraws++;
   refresh_screen();
 }
 
@@ -3588,3 +4006,89 @@ char *get_screen_monospace_interface_version()
   return screen_monospace_interface_version;
 }
 
+
+static size_t get_z_ucs_string_size(z_ucs *string)
+{
+  return string != NULL ? sizeof(z_ucs) * (z_ucs_len(string) + 1) : 0;
+}
+
+
+void get_monospace_interface_memory(struct monospace_interface_memory *memory)
+{
+  int i;
+
+  memory->windows = z_windows != NULL
+    ? (sizeof(struct z_window*) + sizeof(struct z_window))
+      * nof_active_z_windows
+    : 0;
+
+  memory->status_line = sizeof(z_ucs) * last_status_room_description_size;
+  if (status_line != NULL)
+    memory->status_line += 2 * sizeof(z_ucs) * (status_line_width + 1);
+
+  memory->localized_strings
+    = get_z_ucs_string_size(libmonospaceif_more_prompt)
+    + get_z_ucs_string_size(libmonospaceif_score_string)
+    + get_z_ucs_string_size(libmonospaceif_turns_string);
+
+  memory->session_total
+    = memory->windows
+    + memory->status_line
+    + memory->localized_strings;
+
+  memory->input_line = input_line_get_memory_size();
+  memory->paragraph_cache = paragraph_cache_get_memory_size();
+  memory->scrollback_index = scrollback_index_get_memory_size();
+  memory->upper_window_cache = upper_window_cache_get_memory_size();
+  memory->shadow_grid = shadow_grid_get_memory_size();
+  memory->draw_op_buffers
+    = draw_op_batch_get_memory_size() + scroll_batch_get_memory_size();
+  memory->trace_ring = trace_ring_get_memory_size();
+
+  // Only the merged list is allocated, see the interface registration.
+  memory->config_option_names = 0;
+  if (config_option_names != my_config_option_names) {
+    for (i=0; config_option_names[i] != NULL; i++)
+      ;
+    memory->config_option_names = sizeof(char*) * (i + 1);
+  }
+
+  memory->shared_total
+    = memory->input_line
+    + memory->paragraph_cache
+    + memory->scrollback_index
+    + memory->upper_window_cache
+    + memory->shadow_grid
+    + memory->draw_op_buffers
+    + memory->trace_ring
+    + memory->config_option_names;
+
+  memory->wordwrappers_estimate = 0;
+  if (z_windows != NULL)
+    for (i=0; i<nof_active_z_windows; i++)
+      memory->wordwrappers_estimate
+        += sizeof(WORDWRAP)
+        + sizeof(z_ucs) * (z_windows[i]->xsize + 1);
+
+  memory->history_output_estimate
+    = history != NULL ? sizeof(history_output) : 0;
+}
+
+
+void get_monospace_interface_stats(struct monospace_interface_stats *stats)
+{
+  *stats = monospace_stats;
+}
+
+
+void reset_monospace_interface_stats()
+{
+  memset(&monospace_stats, 0, sizeof(struct monospace_interface_stats));
+}
+
+
+int dump_monospace_interface_trace(char *filename)
+{
+  return trace_ring_dump(filename);
+}
+
@@ -35,19 +35,79 @@
 #ifndef monospacescreen_h_INCLUDED
 #define monospacescreen_h_INCLUDED
 
-#define LIBMONOSPACEINTERFACE_VERSION "0.9.0"
+#define LIBMONOSPACEINTERFACE_VERSION "0.10.0"
 
 #include "../screen_interface/screen_monospace_interface.h"
 
 #define MAX_MARGIN_SIZE 100
 #define MAX_MARGIN_AS_STRING_LEN 4
 
+// Counters kept by the library for as long as the process runs. The call
+// counters refer to calls passed on towards the screen interface.
+struct monospace_interface_stats
+{
+  long goto_yx_calls;
+  long z_ucs_output_calls;
+  long copy_area_calls;
+  long clear_area_calls;
+  long scroll_region_calls;
+  long set_colour_calls;
+  long set_text_style_calls;
+  long characters_output;
+  long window0_refreshes;
+  long paragraphs_replayed;
+  long more_prompts;
+  long resize_redraws;
+};
+
 void fizmo_register_screen_monospace_interface(
     struct z_screen_monospace_interface *screen_monospace_interface);
+// Only records the new size, the screen is redrawn once no further resize
+// has arrived for 100 ms while waiting for input. A pending resize is also
+// applied before the screen is refreshed and when output reaches a more
+// prompt, so that no prompt is drawn according to the old size. Until then
+// output keeps using the old geometry.
 void new_monospace_screen_size(int newysize, int newxsize);
 void set_custom_left_monospace_margin(int width);
 void set_custom_right_monospace_margin(int width);
 char *get_screen_monospace_interface_version();
+void get_monospace_interface_stats(struct monospace_interface_stats *stats);
+void reset_monospace_interface_stats();
+int dump_monospace_interface_trace(char *filename);
+
+// The library and libfizmo keep their state process-wide, so only one
+// story can be open per process, and all calls have to be made from one
+// thread at a time. Hosts serving many players have to shard them over
+// processes, for example one per core.
+
+// Bytes held by the library. The first group belongs to the open story and
+// is freed when it's closed, the second one is kept for the process and is
+// only counted in "shared_total". The last group is allocated by libfizmo
+// and can't be measured from here. These are estimates only, from the
+// struct sizes plus one line of text per word wrapper, and are included in
+// neither total. The output history itself isn't covered at all.
+struct monospace_interface_memory
+{
+  size_t windows;
+  size_t status_line;
+  size_t localized_strings;
+  size_t session_total;
+
+  size_t input_line;
+  size_t paragraph_cache;
+  size_t scrollback_index;
+  size_t upper_window_cache;
+  size_t shadow_grid;
+  size_t draw_op_buffers;
+  size_t trace_ring;
+  size_t config_option_names;
+  size_t shared_total;
+
+  size_t wordwrappers_estimate;
+  size_t history_output_estimate;
+};
+
+void get_monospace_interface_memory(struct monospace_interface_memory *memory);
 
 #endif // monospacescreen_h_INCLUDED
 
@@ -0,0 +1,142 @@
+/* paragraph_cache.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "interpreter/fizmo.h"
+
+#include "paragraph_cache.h"
+
+
+// Number of entries, must be a power of two. Entries are direct-mapped, a
+// colliding store simply replaces the older entry.
+#define PARAGRAPH_CACHE_SIZE 1024
+
+struct paragraph_cache_entry {
+  void *paragraph_start;
+  void *paragraph_end;
+  int line_width;
+  unsigned long history_generation;
+  int nof_lines;
+};
+
+static struct paragraph_cache_entry *entries = NULL;
+
+
+static int get_entry_index(void *paragraph_start, void *paragraph_end,
+    int line_width, unsigned long history_generation) {
+  uintptr_t hash;
+
+  hash = ((uintptr_t)paragraph_start >> 2) * 31;
+  hash ^= (uintptr_t)paragraph_end >> 2;
+  hash ^= (uintptr_t)line_width * 2654435761u;
+  hash ^= (uintptr_t)history_generation * 40503u;
+  hash ^= hash >> 13;
+
+  return (int)(hash & (PARAGRAPH_CACHE_SIZE - 1));
+}
+
+
+// Returns the cached number of lines or -1 if the paragraph is unknown.
+int paragraph_cache_lookup(void *paragraph_start, void *paragraph_end,
+    int line_width, unsigned long history_generation) {
+  struct paragraph_cache_entry *entry;
+
+  if (entries == NULL)
+    return -1;
+
+  entry = &entries[get_entry_index(
+      paragraph_start, paragraph_end, line_width, history_generation)];
+
+  if ( (entry->paragraph_start == paragraph_start)
+      && (entry->paragraph_end == paragraph_end)
+      && (entry->line_width == line_width)
+      && (entry->history_generation == history_generation) )
+    return entry->nof_lines;
+
+  return -1;
+}
+
+
+void paragraph_cache_store(void *paragraph_start, void *paragraph_end,
+    int line_width, unsigned long history_generation, int nof_lines) {
+  struct paragraph_cache_entry *entry;
+
+  if (entries == NULL) {
+    entries = fizmo_malloc(
+        sizeof(struct paragraph_cache_entry) * PARAGRAPH_CACHE_SIZE);
+    paragraph_cache_invalidate();
+  }
+
+  entry = &entries[get_entry_index(
+      paragraph_start, paragraph_end, line_width, history_generation)];
+
+  entry->paragraph_start = paragraph_start;
+  entry->paragraph_end = paragraph_end;
+  entry->line_width = line_width;
+  entry->history_generation = history_generation;
+  entry->nof_lines = nof_lines;
+}
+
+
+void paragraph_cache_invalidate() {
+  int i;
+
+  if (entries == NULL)
+    return;
+
+  TRACE_LOG("Invalidating paragraph cache.\n");
+
+  for (i=0; i<PARAGRAPH_CACHE_SIZE; i++) {
+    entries[i].paragraph_start = NULL;
+    entries[i].paragraph_end = NULL;
+    entries[i].line_width = -1;
+  }
+}
+
+
+size_t paragraph_cache_get_memory_size() {
+  return entries != NULL
+    ? sizeof(struct paragraph_cache_entry) * PARAGRAPH_CACHE_SIZE
+    : 0;
+}
+
+
+void paragraph_cache_free() {
+  free(entries);
+  entries = NULL;
+}
+
@@ -0,0 +1,55 @@
+/* paragraph_cache.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef paragraph_cache_h_INCLUDED
+#define paragraph_cache_h_INCLUDED
+
+#include <stddef.h>
+
+// Stores the number of screen lines a history paragraph occupies when
+// wrapped at a given line width. Paragraphs are identified by the history
+// positions of their start and their end, so a paragraph which is still
+// being extended by new output never matches a stale entry. Since the
+// history may reuse positions once it wraps around or is moved, the
+// history's generation is part of the key as well.
+
+int paragraph_cache_lookup(void *paragraph_start, void *paragraph_end,
+    int line_width, unsigned long history_generation);
+void paragraph_cache_store(void *paragraph_start, void *paragraph_end,
+    int line_width, unsigned long history_generation, int nof_lines);
+void paragraph_cache_invalidate();
+size_t paragraph_cache_get_memory_size();
+void paragraph_cache_free();
+
+#endif /* paragraph_cache_h_INCLUDED */
+
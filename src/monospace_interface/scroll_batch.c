@@ -0,0 +1,435 @@
+/* scroll_batch.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "tools/z_ucs.h"
+
+#include "scroll_batch.h"
+#include "draw_op_buffer.h"
+#include "z_ucs_span.h"
+
+
+static struct z_screen_monospace_interface *target = NULL;
+static struct z_screen_monospace_interface scroll_interface;
+static struct draw_op_buffer buffer;
+
+// The region scrolled by the pending copies: rows "region_top" up to and
+// including "region_bottom", starting at column "region_x". A native
+// region is scrolled using the target's "scroll_region".
+static int region_top, region_bottom, region_x, region_width;
+static bool region_is_native = false;
+static int nof_pending_scrolls = 0;
+
+// What the library assumes the target's state to be.
+static int cursor_y = 1, cursor_x = 1;
+static z_style current_style = 0;
+static bool cursor_needs_goto = false;
+
+// The style last passed to the target, -1 if unknown.
+static z_style target_style = -1;
+
+// The colours last set by the library, if any.
+static z_colour current_foreground, current_background;
+static bool colours_known = false;
+
+
+// Every recorded cursor movement keeps the number of scrolls which were
+// pending at that time in its otherwise unused "srcy" field, so that it
+// can be moved up by the scrolls following it.
+static void replay_ops() {
+  struct z_screen_draw_op *op;
+  bool skipping = false;
+  int i, y;
+
+  for (i=0; i<buffer.nof_ops; i++) {
+    op = &buffer.ops[i];
+
+    if (op->type == DRAW_OP_GOTO_YX) {
+      y = op->y;
+      if ( (y >= region_top) && (y <= region_bottom) )
+        y -= nof_pending_scrolls - op->srcy;
+      // Anything written to a line which has already been scrolled out
+      // of the region again would be lost anyway.
+      skipping = y < region_top ? true : false;
+      if (skipping == false)
+        target->goto_yx(y, op->x);
+    }
+    else if (op->type == DRAW_OP_SET_COLOUR) {
+      target->set_colour(op->foreground, op->background);
+    }
+    else if (skipping == false) {
+      if (op->text_style != target_style) {
+        target_style = op->text_style;
+        target->set_text_style(target_style);
+      }
+
+      if (op->type == DRAW_OP_CLEAR_TO_EOL)
+        target->clear_to_eol();
+      else
+        z_ucs_span_output(target, op->text, op->text_length);
+    }
+  }
+
+  if (target_style != current_style)
+    target->set_text_style(current_style);
+}
+
+
+static void flush_scrolls() {
+  int region_height;
+
+  if (nof_pending_scrolls == 0)
+    return;
+
+  region_height = region_bottom - region_top + 1;
+
+  TRACE_LOG("Flushing %d scrolls of rows %d-%d, %d ops.\n",
+      nof_pending_scrolls, region_top, region_bottom, buffer.nof_ops);
+
+  // Since the library clears every line scrolled in, the rows left over
+  // by a single copy are overwritten by the replayed operations.
+  if (region_is_native == true)
+    target->scroll_region(region_top, region_bottom,
+        nof_pending_scrolls < region_height
+        ? nof_pending_scrolls : region_height);
+  else if (nof_pending_scrolls < region_height)
+    target->copy_area(region_top, region_x,
+        region_top + nof_pending_scrolls, region_x,
+        region_height - nof_pending_scrolls, region_width);
+
+  replay_ops();
+  target->goto_yx(cursor_y, cursor_x);
+
+  draw_op_buffer_clear(&buffer);
+  nof_pending_scrolls = 0;
+  cursor_needs_goto = false;
+}
+
+
+// Records the cursor position in case a scroll happened since the last
+// movement. Returns false in case the buffer was full and the pending
+// scrolls had to be flushed.
+static bool record_cursor_position() {
+  struct z_screen_draw_op *op;
+
+  if (cursor_needs_goto == false)
+    return true;
+
+  if ((op = draw_op_buffer_append(&buffer, DRAW_OP_GOTO_YX)) == NULL) {
+    flush_scrolls();
+    return false;
+  }
+
+  op->y = cursor_y;
+  op->x = cursor_x;
+  op->srcy = nof_pending_scrolls;
+  cursor_needs_goto = false;
+
+  return true;
+}
+
+
+// Returns a new operation or NULL in case the buffer was full and the
+// pending scrolls had to be flushed, meaning the operation has to be
+// passed to the target directly.
+static struct z_screen_draw_op *append_op(int type) {
+  struct z_screen_draw_op *result;
+
+  if (record_cursor_position() == false)
+    return NULL;
+
+  if ((result = draw_op_buffer_append(&buffer, type)) == NULL)
+    flush_scrolls();
+
+  return result;
+}
+
+
+static void scroll_goto_yx(int y, int x) {
+  struct z_screen_draw_op *op;
+
+  cursor_y = y;
+  cursor_x = x;
+
+  if (nof_pending_scrolls == 0) {
+    target->goto_yx(y, x);
+    return;
+  }
+
+  cursor_needs_goto = false;
+  if ((op = append_op(DRAW_OP_GOTO_YX)) == NULL) {
+    target->goto_yx(y, x);
+    return;
+  }
+
+  op->y = y;
+  op->x = x;
+  op->srcy = nof_pending_scrolls;
+}
+
+
+static void scroll_z_ucs_output_n(const z_ucs *output, size_t length) {
+  size_t stored = 0;
+
+  if ( (nof_pending_scrolls > 0) && (record_cursor_position() == true) ) {
+    stored = draw_op_buffer_append_text(&buffer, output, length,
+        current_style);
+    cursor_x += stored;
+    if (stored == length)
+      return;
+    flush_scrolls();
+  }
+
+  z_ucs_span_output(target, output + stored, length - stored);
+  cursor_x += length - stored;
+}
+
+
+static void scroll_z_ucs_output(z_ucs *output) {
+  scroll_z_ucs_output_n(output, z_ucs_len(output));
+}
+
+
+static void scroll_set_text_style(z_style text_style) {
+  current_style = text_style;
+
+  if (nof_pending_scrolls == 0) {
+    target->set_text_style(text_style);
+    target_style = text_style;
+  }
+}
+
+
+static void scroll_set_colour(z_colour foreground, z_colour background) {
+  struct z_screen_draw_op *op;
+  bool colours_changed
+    = ( (colours_known == false)
+        || (foreground != current_foreground)
+        || (background != current_background) ) ? true : false;
+
+  current_foreground = foreground;
+  current_background = background;
+  colours_known = true;
+
+  // A native scroll fills the rows scrolled in with the target's colours
+  // at the time of the flush, and the library doesn't clear these rows
+  // itself. Pending scrolls have to be done before the colours change.
+  if ( (region_is_native == true) && (colours_changed == true) )
+    flush_scrolls();
+
+  if ( (nof_pending_scrolls == 0)
+      || ((op = append_op(DRAW_OP_SET_COLOUR)) == NULL) ) {
+    target->set_colour(foreground, background);
+    return;
+  }
+
+  op->foreground = foreground;
+  op->background = background;
+}
+
+
+static void scroll_copy_area(int dsty, int dstx, int srcy, int srcx,
+    int height, int width) {
+
+  // Only copies moving a region up by a single line are collected, and
+  // only as long as they all scroll the same region.
+  if ( (srcy == dsty + 1) && (srcx == dstx) && (height > 0)
+      && ( (nof_pending_scrolls == 0)
+        || ( (region_is_native == false)
+          && (dsty == region_top) && (dstx == region_x)
+          && (dsty + height == region_bottom) && (width == region_width) ) ) ) {
+    if (nof_pending_scrolls == 0) {
+      region_top = dsty;
+      region_bottom = dsty + height;
+      region_x = dstx;
+      region_width = width;
+      region_is_native = false;
+    }
+    nof_pending_scrolls++;
+    // The cursor keeps its screen position while the text moves up, so
+    // it has to be re-recorded for the next operation.
+    cursor_needs_goto = true;
+    return;
+  }
+
+  flush_scrolls();
+  target->copy_area(dsty, dstx, srcy, srcx, height, width);
+}
+
+
+static void scroll_scroll_region(int top, int bottom, int lines) {
+  if ( (lines == 1) && (bottom > top)
+      && ( (nof_pending_scrolls == 0)
+        || ( (region_is_native == true)
+          && (top == region_top) && (bottom == region_bottom) ) ) ) {
+    if (nof_pending_scrolls == 0) {
+      region_top = top;
+      region_bottom = bottom;
+      region_is_native = true;
+    }
+    nof_pending_scrolls++;
+    cursor_needs_goto = true;
+    return;
+  }
+
+  flush_scrolls();
+  target->scroll_region(top, bottom, lines);
+}
+
+
+static void scroll_clear_to_eol() {
+  struct z_screen_draw_op *op;
+
+  if ( (nof_pending_scrolls == 0)
+      || ((op = append_op(DRAW_OP_CLEAR_TO_EOL)) == NULL) ) {
+    target->clear_to_eol();
+    return;
+  }
+
+  op->text_style = current_style;
+}
+
+
+static void scroll_clear_area(int startx, int starty, int xsize, int ysize) {
+  flush_scrolls();
+  target->clear_area(startx, starty, xsize, ysize);
+}
+
+
+static void scroll_set_font(z_font font_type) {
+  flush_scrolls();
+  target->set_font(font_type);
+}
+
+
+static void scroll_update_screen() {
+  flush_scrolls();
+  target->update_screen();
+}
+
+
+static void scroll_redraw_screen_from_scratch() {
+  flush_scrolls();
+  target->redraw_screen_from_scratch();
+}
+
+
+static void scroll_set_cursor_visibility(bool visible) {
+  flush_scrolls();
+  target->set_cursor_visibility(visible);
+}
+
+
+static int scroll_get_next_event(z_ucs *input, int timeout_millis) {
+  if (nof_pending_scrolls > 0) {
+    flush_scrolls();
+    target->update_screen();
+  }
+
+  return target->get_next_event(input, timeout_millis);
+}
+
+
+static int scroll_close_interface(z_ucs *error_message) {
+  flush_scrolls();
+  return target->close_interface(error_message);
+}
+
+
+static int scroll_prompt_for_filename(char *filename_suggestion,
+    z_file **result_file, char *directory, int filetype_or_mode,
+    int fileaccess) {
+  flush_scrolls();
+  return target->prompt_for_filename(filename_suggestion, result_file,
+      directory, filetype_or_mode, fileaccess);
+}
+
+
+struct z_screen_monospace_interface *scroll_batch_wrap_interface(
+    struct z_screen_monospace_interface *new_target) {
+  if (target != NULL)
+    return &scroll_interface;
+
+  TRACE_LOG("Activating scroll batching.\n");
+
+  target = new_target;
+  draw_op_buffer_init(&buffer);
+  nof_pending_scrolls = 0;
+  cursor_needs_goto = false;
+  colours_known = false;
+  cursor_y = 1;
+  cursor_x = 1;
+  current_style = 0;
+  target_style = -1;
+
+  scroll_interface = *target;
+  scroll_interface.goto_yx = &scroll_goto_yx;
+  scroll_interface.z_ucs_output = &scroll_z_ucs_output;
+  scroll_interface.z_ucs_output_n = &scroll_z_ucs_output_n;
+  scroll_interface.set_text_style = &scroll_set_text_style;
+  scroll_interface.set_colour = &scroll_set_colour;
+  scroll_interface.set_font = &scroll_set_font;
+  scroll_interface.copy_area = &scroll_copy_area;
+  scroll_interface.clear_to_eol = &scroll_clear_to_eol;
+  scroll_interface.clear_area = &scroll_clear_area;
+  if (target->scroll_region != NULL)
+    scroll_interface.scroll_region = &scroll_scroll_region;
+  scroll_interface.update_screen = &scroll_update_screen;
+  scroll_interface.redraw_screen_from_scratch
+    = &scroll_redraw_screen_from_scratch;
+  scroll_interface.set_cursor_visibility = &scroll_set_cursor_visibility;
+  scroll_interface.get_next_event = &scroll_get_next_event;
+  scroll_interface.close_interface = &scroll_close_interface;
+  if (target->prompt_for_filename != NULL)
+    scroll_interface.prompt_for_filename = &scroll_prompt_for_filename;
+  scroll_interface.draw_ops = NULL;
+
+  return &scroll_interface;
+}
+
+
+struct z_screen_monospace_interface *scroll_batch_unwrap_interface() {
+  struct z_screen_monospace_interface *result = target;
+
+  draw_op_buffer_free(&buffer);
+  target = NULL;
+
+  return result;
+}
+
+
+size_t scroll_batch_get_memory_size() {
+  return draw_op_buffer_get_memory_size(&buffer);
+}
+
@@ -0,0 +1,194 @@
+/* scrollback_index.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "interpreter/fizmo.h"
+
+#include "scrollback_index.h"
+
+
+#define SCROLLBACK_INDEX_INCREMENT_SIZE 1024
+
+// Number of line widths for which an index is kept, so that flipping
+// between a few window sizes doesn't require measuring everything again.
+#define SCROLLBACK_INDEX_NOF_LAYOUTS 3
+
+// top_lines[n] is the history screen line at which paragraph n starts. Since
+// every paragraph occupies at least one line, the array is strictly
+// increasing.
+struct scrollback_layout {
+  int *top_lines;
+  int nof_top_lines;
+  int top_lines_size;
+  void *history_front;
+  unsigned long history_generation;
+  int line_width;
+  long last_used;
+};
+
+static struct scrollback_layout layouts[SCROLLBACK_INDEX_NOF_LAYOUTS];
+static struct scrollback_layout *current = &layouts[0];
+static long use_counter = 0;
+
+
+static void clear_layout(struct scrollback_layout *layout) {
+  layout->nof_top_lines = 0;
+  layout->history_front = NULL;
+  layout->line_width = -1;
+}
+
+
+// Selects the index for the given line width, replacing the least recently
+// used one if there is none yet. The index is dropped unless it has been
+// built for the same history end in the same history generation.
+void scrollback_index_reset(void *history_front,
+    unsigned long history_generation, int line_width) {
+  int i;
+
+  for (i=0; i<SCROLLBACK_INDEX_NOF_LAYOUTS; i++)
+    if (layouts[i].line_width == line_width)
+      break;
+
+  if (i == SCROLLBACK_INDEX_NOF_LAYOUTS) {
+    for (i=1, current=&layouts[0]; i<SCROLLBACK_INDEX_NOF_LAYOUTS; i++)
+      if (layouts[i].last_used < current->last_used)
+        current = &layouts[i];
+    clear_layout(current);
+    current->line_width = line_width;
+  }
+  else
+    current = &layouts[i];
+
+  current->last_used = ++use_counter;
+
+  if ( (history_front != current->history_front)
+      || (history_generation != current->history_generation) ) {
+    TRACE_LOG("Resetting scrollback index for width %d.\n", line_width);
+    current->nof_top_lines = 0;
+    current->history_front = history_front;
+    current->history_generation = history_generation;
+  }
+}
+
+
+void scrollback_index_invalidate() {
+  int i;
+
+  for (i=0; i<SCROLLBACK_INDEX_NOF_LAYOUTS; i++)
+    clear_layout(&layouts[i]);
+}
+
+
+int scrollback_index_get_size() {
+  return current->nof_top_lines;
+}
+
+
+int scrollback_index_get_top_line(int paragraph) {
+  return current->top_lines[paragraph];
+}
+
+
+// Returns the number of paragraphs which have to be rewound from the end of
+// the history to arrive at the given line, or -1 if the line is not a known
+// paragraph start.
+int scrollback_index_get_paragraph(int history_screen_line) {
+  int index;
+
+  if (history_screen_line == 0)
+    return 0;
+
+  index = scrollback_index_find_line(history_screen_line);
+
+  return (index >= 0) && (current->top_lines[index] == history_screen_line)
+    ? index + 1
+    : -1;
+}
+
+
+// Returns the first paragraph starting at or above the given line, or -1 if
+// no such paragraph has been indexed yet.
+int scrollback_index_find_line(int history_screen_line) {
+  int bottom = 0, top = current->nof_top_lines, middle;
+
+  while (bottom < top) {
+    middle = bottom + (top - bottom) / 2;
+    if (current->top_lines[middle] < history_screen_line)
+      bottom = middle + 1;
+    else
+      top = middle;
+  }
+
+  return bottom < current->nof_top_lines ? bottom : -1;
+}
+
+
+void scrollback_index_append(int top_line) {
+  if (current->nof_top_lines == current->top_lines_size) {
+    current->top_lines_size += SCROLLBACK_INDEX_INCREMENT_SIZE;
+    current->top_lines = fizmo_realloc(
+        current->top_lines, sizeof(int) * current->top_lines_size);
+  }
+
+  current->top_lines[current->nof_top_lines++] = top_line;
+}
+
+
+size_t scrollback_index_get_memory_size() {
+  size_t result = 0;
+  int i;
+
+  for (i=0; i<SCROLLBACK_INDEX_NOF_LAYOUTS; i++)
+    result += sizeof(int) * layouts[i].top_lines_size;
+
+  return result;
+}
+
+
+void scrollback_index_free() {
+  int i;
+
+  for (i=0; i<SCROLLBACK_INDEX_NOF_LAYOUTS; i++) {
+    free(layouts[i].top_lines);
+    layouts[i].top_lines = NULL;
+    layouts[i].top_lines_size = 0;
+    layouts[i].last_used = 0;
+    clear_layout(&layouts[i]);
+  }
+
+  current = &layouts[0];
+}
+
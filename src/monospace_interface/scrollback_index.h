@@ -0,0 +1,57 @@
+/* scrollback_index.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef scrollback_index_h_INCLUDED
+#define scrollback_index_h_INCLUDED
+
+#include <stddef.h>
+
+// Remembers, for the paragraphs measured while scrolling back, the screen
+// line -- counted from the end of the history like current_history_screen_line
+// -- at which each paragraph begins. Paragraph 0 is the last paragraph in the
+// history. An index is only valid for one history end, history generation
+// and line width, indices for the most recently used line widths are kept.
+
+void scrollback_index_reset(void *history_front,
+    unsigned long history_generation, int line_width);
+void scrollback_index_invalidate();
+int scrollback_index_get_size();
+int scrollback_index_get_top_line(int paragraph);
+int scrollback_index_get_paragraph(int history_screen_line);
+int scrollback_index_find_line(int history_screen_line);
+void scrollback_index_append(int top_line);
+size_t scrollback_index_get_memory_size();
+void scrollback_index_free();
+
+#endif /* scrollback_index_h_INCLUDED */
+
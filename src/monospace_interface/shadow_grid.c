@@ -0,0 +1,707 @@
+/* shadow_grid.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "tools/z_ucs.h"
+#include "interpreter/fizmo.h"
+
+#include "shadow_grid.h"
+
+
+// Cell attributes are packed into a single 64 bit word: The text style is
+// stored in bits 0-15, the foreground colour in bits 16-31 and the
+// background colour in bits 32-47, each with the full width of its type so
+// that negative colours survive the round trip. Bit 48 is set as long as no
+// colour has been set at all, in which case the backend's colours are never
+// touched.
+#define SHADOW_ATTRIBUTES(style, foreground, background) \
+  (((uint64_t)(uint16_t)(style)) \
+   | (((uint64_t)(uint16_t)(foreground)) << 16) \
+   | (((uint64_t)(uint16_t)(background)) << 32))
+#define SHADOW_STYLE(attributes) ((z_style)(int16_t)((attributes) & 0xffff))
+#define SHADOW_FOREGROUND(attributes) \
+  ((z_colour)(int16_t)(((attributes) >> 16) & 0xffff))
+#define SHADOW_BACKGROUND(attributes) \
+  ((z_colour)(int16_t)(((attributes) >> 32) & 0xffff))
+#define SHADOW_COLOURS_UNSET ((uint64_t)1 << 48)
+#define SHADOW_UNKNOWN_ATTRIBUTES UINT64_MAX
+
+// Used for the backend's state while it's unknown, outside of the range of
+// styles and colours.
+#define SHADOW_UNKNOWN_TARGET_VALUE INT32_MIN
+
+// Runs of unchanged cells shorter than this are re-sent instead of
+// repositioning the cursor behind them.
+#define SHADOW_MAX_GAP 4
+
+#define SHADOW_MAX_PENDING_COPIES 16
+
+struct shadow_cell {
+  z_ucs character;
+  uint64_t attributes;
+};
+
+struct shadow_copy {
+  int dsty, dstx, srcy, srcx, height, width;
+};
+
+static struct z_screen_monospace_interface *target = NULL;
+static struct z_screen_monospace_interface shadow_interface;
+
+static int grid_height = 0;
+static int grid_width = 0;
+
+// "front" stores what the library has written, "back" what the backend is
+// currently displaying.
+static struct shadow_cell *front = NULL;
+static struct shadow_cell *back = NULL;
+static bool *dirty_rows = NULL;
+static z_ucs *run_buffer = NULL;
+
+static int cursor_y = 1;
+static int cursor_x = 1;
+static z_style current_style = 0;
+static z_colour current_foreground = 0;
+static z_colour current_background = 0;
+static bool colours_set = false;
+
+// State of the backend. Negative cursor positions are used for "unknown".
+static int target_cursor_y = -1;
+static int target_cursor_x = -1;
+static int target_style = SHADOW_UNKNOWN_TARGET_VALUE;
+static int target_foreground = SHADOW_UNKNOWN_TARGET_VALUE;
+static int target_background = SHADOW_UNKNOWN_TARGET_VALUE;
+
+static struct shadow_copy pending_copies[SHADOW_MAX_PENDING_COPIES];
+static int nof_pending_copies = 0;
+
+
+static uint64_t get_attributes(z_style style) {
+  return colours_set == true
+    ? SHADOW_ATTRIBUTES(style, current_foreground, current_background)
+    : SHADOW_ATTRIBUTES(style, 0, 0) | SHADOW_COLOURS_UNSET;
+}
+
+
+static void fill_cells(struct shadow_cell *cells, int nof_cells,
+    uint64_t attributes) {
+  while (nof_cells-- > 0) {
+    cells->character = Z_UCS_SPACE;
+    cells->attributes = attributes;
+    cells++;
+  }
+}
+
+
+static void mark_all_rows_dirty() {
+  int y;
+
+  for (y=0; y<grid_height; y++)
+    dirty_rows[y] = true;
+}
+
+
+static void allocate_grid(int height, int width) {
+  grid_height = height;
+  grid_width = width;
+
+  front = fizmo_malloc(sizeof(struct shadow_cell) * height * width);
+  back = fizmo_malloc(sizeof(struct shadow_cell) * height * width);
+  dirty_rows = fizmo_malloc(sizeof(bool) * height);
+  run_buffer = fizmo_malloc(sizeof(z_ucs) * (width + 1));
+
+  fill_cells(front, height * width, SHADOW_ATTRIBUTES(0, 0, 0)
+      | SHADOW_COLOURS_UNSET);
+  fill_cells(back, height * width, SHADOW_UNKNOWN_ATTRIBUTES);
+  mark_all_rows_dirty();
+}
+
+
+static void free_grid() {
+  free(front);
+  free(back);
+  free(dirty_rows);
+  free(run_buffer);
+  front = NULL;
+  back = NULL;
+  dirty_rows = NULL;
+  run_buffer = NULL;
+}
+
+
+// Clips the given rectangle (1-based coordinates) to the grid. Returns
+// false in case nothing remains.
+static bool clip_area(int *y, int *x, int *height, int *width) {
+  if (*y < 1) {
+    *height += *y - 1;
+    *y = 1;
+  }
+  if (*x < 1) {
+    *width += *x - 1;
+    *x = 1;
+  }
+  if (*y - 1 + *height > grid_height)
+    *height = grid_height - (*y - 1);
+  if (*x - 1 + *width > grid_width)
+    *width = grid_width - (*x - 1);
+
+  return ( (*height > 0) && (*width > 0) ) ? true : false;
+}
+
+
+static void copy_cells(struct shadow_cell *cells, int dsty, int dstx,
+    int srcy, int srcx, int height, int width) {
+  int i;
+
+  // Copy rows in an order which doesn't overwrite source rows before
+  // they're used.
+  if (dsty <= srcy) {
+    for (i=0; i<height; i++)
+      memmove(
+          cells + (dsty - 1 + i) * grid_width + dstx - 1,
+          cells + (srcy - 1 + i) * grid_width + srcx - 1,
+          sizeof(struct shadow_cell) * width);
+  }
+  else {
+    for (i=height-1; i>=0; i--)
+      memmove(
+          cells + (dsty - 1 + i) * grid_width + dstx - 1,
+          cells + (srcy - 1 + i) * grid_width + srcx - 1,
+          sizeof(struct shadow_cell) * width);
+  }
+}
+
+
+static bool cells_equal(struct shadow_cell *a, struct shadow_cell *b) {
+  return ( (a->character == b->character)
+      && (a->attributes == b->attributes) ) ? true : false;
+}
+
+
+// Compared cell by cell, since the padding in "struct shadow_cell" is
+// never initialized.
+static bool cell_rows_equal(struct shadow_cell *a, struct shadow_cell *b,
+    int width) {
+  int i;
+
+  for (i=0; i<width; i++)
+    if (cells_equal(a + i, b + i) == false)
+      return false;
+
+  return true;
+}
+
+
+static void shadow_goto_yx(int y, int x) {
+  cursor_y = y;
+  cursor_x = x;
+}
+
+
+static void shadow_z_ucs_output_n(const z_ucs *output, size_t length) {
+  struct shadow_cell *cell;
+  uint64_t attributes = get_attributes(current_style);
+  const z_ucs *output_end = output + length;
+
+  while (output < output_end) {
+    if (*output == Z_UCS_NEWLINE) {
+      cursor_y++;
+      cursor_x = 1;
+    }
+    else {
+      if ( (cursor_y >= 1) && (cursor_y <= grid_height)
+          && (cursor_x >= 1) && (cursor_x <= grid_width) ) {
+        cell = front + (cursor_y - 1) * grid_width + cursor_x - 1;
+        cell->character = *output;
+        cell->attributes = attributes;
+        dirty_rows[cursor_y - 1] = true;
+      }
+      cursor_x++;
+    }
+    output++;
+  }
+}
+
+
+static void shadow_z_ucs_output(z_ucs *output) {
+  shadow_z_ucs_output_n(output, z_ucs_len(output));
+}
+
+
+static void shadow_set_text_style(z_style text_style) {
+  current_style = text_style;
+}
+
+
+static void shadow_set_colour(z_colour foreground, z_colour background) {
+  current_foreground = foreground;
+  current_background = background;
+  colours_set = true;
+}
+
+
+static void shadow_clear_area(int startx, int starty, int xsize, int ysize) {
+  int y;
+
+  if (clip_area(&starty, &startx, &ysize, &xsize) == false)
+    return;
+
+  for (y=starty; y<starty+ysize; y++) {
+    fill_cells(front + (y - 1) * grid_width + startx - 1, xsize,
+        get_attributes(0));
+    dirty_rows[y - 1] = true;
+  }
+}
+
+
+static void shadow_clear_to_eol() {
+  shadow_clear_area(cursor_x, cursor_y, grid_width - cursor_x + 1, 1);
+}
+
+
+// Two consecutive copies of the same screen region in the same direction
+// -- which is what scrolling line by line produces -- are merged into a
+// single copy.
+static bool merge_copy(struct shadow_copy *last, struct shadow_copy *next) {
+  int last_top, last_bottom, next_top, next_bottom, shift, region_height;
+
+  if ( (last->dstx != next->dstx) || (last->srcx != next->srcx)
+      || (last->dstx != last->srcx) || (last->width != next->width) )
+    return false;
+
+  last_top = last->dsty < last->srcy ? last->dsty : last->srcy;
+  last_bottom = (last->dsty > last->srcy ? last->dsty : last->srcy)
+    + last->height - 1;
+  next_top = next->dsty < next->srcy ? next->dsty : next->srcy;
+  next_bottom = (next->dsty > next->srcy ? next->dsty : next->srcy)
+    + next->height - 1;
+
+  if ( (last_top != next_top) || (last_bottom != next_bottom)
+      || ((last->srcy - last->dsty > 0) != (next->srcy - next->dsty > 0)) )
+    return false;
+
+  shift = (last->srcy - last->dsty) + (next->srcy - next->dsty);
+  region_height = last_bottom - last_top + 1;
+
+  if (abs(shift) >= region_height)
+    return false;
+
+  if (shift > 0) {
+    last->dsty = last_top;
+    last->srcy = last_top + shift;
+  }
+  else {
+    last->srcy = last_top;
+    last->dsty = last_top - shift;
+  }
+  last->height = region_height - abs(shift);
+
+  return true;
+}
+
+
+static void shadow_copy_area(int dsty, int dstx, int srcy, int srcx,
+    int height, int width) {
+  struct shadow_copy copy;
+  int y;
+
+  // Clip both source and destination against the grid.
+  if (srcy < 1) { height += srcy - 1; dsty -= srcy - 1; srcy = 1; }
+  if (dsty < 1) { height += dsty - 1; srcy -= dsty - 1; dsty = 1; }
+  if (srcx < 1) { width += srcx - 1; dstx -= srcx - 1; srcx = 1; }
+  if (dstx < 1) { width += dstx - 1; srcx -= dstx - 1; dstx = 1; }
+  if (srcy - 1 + height > grid_height) height = grid_height - (srcy - 1);
+  if (dsty - 1 + height > grid_height) height = grid_height - (dsty - 1);
+  if (srcx - 1 + width > grid_width) width = grid_width - (srcx - 1);
+  if (dstx - 1 + width > grid_width) width = grid_width - (dstx - 1);
+
+  if ( (height <= 0) || (width <= 0) )
+    return;
+
+  copy_cells(front, dsty, dstx, srcy, srcx, height, width);
+  for (y=dsty; y<dsty+height; y++)
+    dirty_rows[y - 1] = true;
+
+  // The copy itself is only remembered here. It's decided during the
+  // next flush whether sending it to the backend is worth it.
+  copy.dsty = dsty;
+  copy.dstx = dstx;
+  copy.srcy = srcy;
+  copy.srcx = srcx;
+  copy.height = height;
+  copy.width = width;
+
+  if ( (nof_pending_copies > 0)
+      && (merge_copy(&pending_copies[nof_pending_copies - 1], &copy) == true))
+    return;
+
+  if (nof_pending_copies < SHADOW_MAX_PENDING_COPIES)
+    pending_copies[nof_pending_copies++] = copy;
+}
+
+
+static void sync_target_attributes(uint64_t attributes) {
+  z_style style = SHADOW_STYLE(attributes);
+  z_colour foreground = SHADOW_FOREGROUND(attributes);
+  z_colour background = SHADOW_BACKGROUND(attributes);
+
+  if (target_style != style) {
+    target->set_text_style(style);
+    target_style = style;
+  }
+
+  if ( ((attributes & SHADOW_COLOURS_UNSET) == 0)
+      && ( (target_foreground != foreground)
+        || (target_background != background) ) ) {
+    target->set_colour(foreground, background);
+    target_foreground = foreground;
+    target_background = background;
+  }
+}
+
+
+static void sync_target_cursor(int y, int x) {
+  if ( (target_cursor_y != y) || (target_cursor_x != x) ) {
+    target->goto_yx(y, x);
+    target_cursor_y = y;
+    target_cursor_x = x;
+  }
+}
+
+
+// Returns the number of rows in the copy's destination which would
+// match the front grid after applying the copy to the backend minus the
+// number of rows matching right now.
+static int evaluate_copy(struct shadow_copy *copy) {
+  int i, result = 0;
+  struct shadow_cell *front_row, *back_row, *source_row;
+
+  for (i=0; i<copy->height; i++) {
+    front_row = front + (copy->dsty - 1 + i) * grid_width + copy->dstx - 1;
+    back_row = back + (copy->dsty - 1 + i) * grid_width + copy->dstx - 1;
+    source_row = back + (copy->srcy - 1 + i) * grid_width + copy->srcx - 1;
+
+    if (cell_rows_equal(front_row, source_row, copy->width) == true)
+      result++;
+    if (cell_rows_equal(front_row, back_row, copy->width) == true)
+      result--;
+  }
+
+  return result;
+}
+
+
+static void flush_pending_copies() {
+  int i, y;
+  struct shadow_copy *copy;
+
+  for (i=0; i<nof_pending_copies; i++) {
+    copy = &pending_copies[i];
+    if (evaluate_copy(copy) > 0) {
+      TRACE_LOG("shadow-grid: sending copy of %d lines.\n", copy->height);
+      target->copy_area(copy->dsty, copy->dstx, copy->srcy, copy->srcx,
+          copy->height, copy->width);
+      copy_cells(back, copy->dsty, copy->dstx, copy->srcy, copy->srcx,
+          copy->height, copy->width);
+      for (y=copy->dsty; y<copy->dsty+copy->height; y++)
+        dirty_rows[y - 1] = true;
+      target_cursor_y = -1;
+    }
+  }
+
+  nof_pending_copies = 0;
+}
+
+
+// Sends cells start to end (0-based, inclusive) of the given row.
+static void send_cells(int y, int start, int end) {
+  struct shadow_cell *front_row = front + y * grid_width;
+  struct shadow_cell *back_row = back + y * grid_width;
+  uint64_t attributes;
+  int run_length;
+
+  while (start <= end) {
+    attributes = front_row[start].attributes;
+    run_length = 0;
+
+    while ( (start + run_length <= end)
+        && (front_row[start + run_length].attributes == attributes) ) {
+      run_buffer[run_length] = front_row[start + run_length].character;
+      back_row[start + run_length] = front_row[start + run_length];
+      run_length++;
+    }
+    run_buffer[run_length] = 0;
+
+    sync_target_attributes(attributes);
+    sync_target_cursor(y + 1, start + 1);
+    target->z_ucs_output(run_buffer);
+    target_cursor_x += run_length;
+
+    start += run_length;
+  }
+}
+
+
+static void flush_row(int y) {
+  struct shadow_cell *front_row = front + y * grid_width;
+  struct shadow_cell *back_row = back + y * grid_width;
+  uint64_t tail_attributes;
+  int tail_start, start, end, gap, x;
+
+  // Find the blank tail of the row which may be sent as "clear_to_eol".
+  tail_attributes = front_row[grid_width - 1].attributes;
+  tail_start = grid_width;
+  if (SHADOW_STYLE(tail_attributes) == 0) {
+    while ( (tail_start > 0)
+        && (front_row[tail_start - 1].character == Z_UCS_SPACE)
+        && (front_row[tail_start - 1].attributes == tail_attributes) )
+      tail_start--;
+  }
+
+  x = 0;
+  while (x < grid_width) {
+    if (cells_equal(&front_row[x], &back_row[x]) == true) {
+      x++;
+      continue;
+    }
+
+    start = x;
+    end = x;
+    gap = 0;
+    while (++x < grid_width) {
+      if (cells_equal(&front_row[x], &back_row[x]) == false) {
+        end = x;
+        gap = 0;
+      }
+      else if (++gap > SHADOW_MAX_GAP)
+        break;
+    }
+
+    if (end >= tail_start) {
+      if (start < tail_start)
+        send_cells(y, start, tail_start - 1);
+      else
+        tail_start = start;
+
+      sync_target_attributes(tail_attributes);
+      sync_target_cursor(y + 1, tail_start + 1);
+      target->clear_to_eol();
+      fill_cells(back_row + tail_start, grid_width - tail_start,
+          tail_attributes);
+      break;
+    }
+
+    send_cells(y, start, end);
+  }
+}
+
+
+static bool flush_grid() {
+  bool output_sent = false;
+  int y;
+
+  flush_pending_copies();
+
+  for (y=0; y<grid_height; y++) {
+    if (dirty_rows[y] == true) {
+      if (cell_rows_equal(front + y * grid_width, back + y * grid_width,
+            grid_width) == false) {
+        flush_row(y);
+        output_sent = true;
+      }
+      dirty_rows[y] = false;
+    }
+  }
+
+  if ( (output_sent == true)
+      || (target_cursor_y != cursor_y) || (target_cursor_x != cursor_x) ) {
+    sync_target_cursor(cursor_y, cursor_x);
+    output_sent = true;
+  }
+
+  return output_sent;
+}
+
+
+static void shadow_update_screen() {
+  flush_grid();
+  target->update_screen();
+}
+
+
+static void shadow_redraw_screen_from_scratch() {
+  flush_grid();
+  target->redraw_screen_from_scratch();
+}
+
+
+static int shadow_get_next_event(z_ucs *input, int timeout_millis) {
+  if (flush_grid() == true)
+    target->update_screen();
+
+  return target->get_next_event(input, timeout_millis);
+}
+
+
+static int shadow_close_interface(z_ucs *error_message) {
+  flush_grid();
+  target->update_screen();
+  return target->close_interface(error_message);
+}
+
+
+// The grid keeps its contents anchored top-left on a resize and repaints
+// all of them, no matter what the backend does.
+static bool shadow_keeps_contents_on_resize() {
+  return true;
+}
+
+
+static int shadow_prompt_for_filename(char *filename_suggestion,
+    z_file **result_file, char *directory, int filetype_or_mode,
+    int fileaccess) {
+  int result;
+
+  flush_grid();
+  result = target->prompt_for_filename(filename_suggestion, result_file,
+      directory, filetype_or_mode, fileaccess);
+
+  // The backend's dialog may have been drawn anywhere on the screen.
+  shadow_grid_invalidate();
+
+  return result;
+}
+
+
+struct z_screen_monospace_interface *shadow_grid_wrap_interface(
+    struct z_screen_monospace_interface *new_target, int height, int width) {
+  if (target != NULL)
+    return &shadow_interface;
+
+  TRACE_LOG("Activating shadow grid for %dx%d screen.\n", width, height);
+
+  target = new_target;
+  allocate_grid(height, width);
+
+  shadow_interface = *target;
+  shadow_interface.goto_yx = &shadow_goto_yx;
+  shadow_interface.z_ucs_output = &shadow_z_ucs_output;
+  shadow_interface.z_ucs_output_n = &shadow_z_ucs_output_n;
+  shadow_interface.set_text_style = &shadow_set_text_style;
+  shadow_interface.set_colour = &shadow_set_colour;
+  shadow_interface.copy_area = &shadow_copy_area;
+  shadow_interface.clear_to_eol = &shadow_clear_to_eol;
+  shadow_interface.clear_area = &shadow_clear_area;
+  shadow_interface.update_screen = &shadow_update_screen;
+  shadow_interface.redraw_screen_from_scratch
+    = &shadow_redraw_screen_from_scratch;
+  shadow_interface.get_next_event = &shadow_get_next_event;
+  shadow_interface.close_interface = &shadow_close_interface;
+  shadow_interface.keeps_contents_on_resize
+    = &shadow_keeps_contents_on_resize;
+  if (target->prompt_for_filename != NULL)
+    shadow_interface.prompt_for_filename = &shadow_prompt_for_filename;
+
+  // Scrolling has to go through "copy_area" so that the grid sees it. The
+  // grid decides itself which copies are worth sending.
+  shadow_interface.scroll_region = NULL;
+
+  return &shadow_interface;
+}
+
+
+struct z_screen_monospace_interface *shadow_grid_unwrap_interface() {
+  struct z_screen_monospace_interface *result = target;
+
+  free_grid();
+  target = NULL;
+  nof_pending_copies = 0;
+
+  return result;
+}
+
+
+size_t shadow_grid_get_memory_size() {
+  if (front == NULL)
+    return 0;
+
+  return 2 * sizeof(struct shadow_cell) * grid_height * grid_width
+    + sizeof(bool) * grid_height
+    + sizeof(z_ucs) * (grid_width + 1);
+}
+
+
+void shadow_grid_resize(int height, int width) {
+  struct shadow_cell *old_front = front;
+  int old_height = grid_height, old_width = grid_width, y, copy_width;
+
+  if ( (target == NULL) || ( (height == grid_height) && (width == grid_width) ))
+    return;
+
+  TRACE_LOG("Resizing shadow grid to %dx%d.\n", width, height);
+
+  front = NULL;
+  free_grid();
+  allocate_grid(height, width);
+
+  // Keep the front contents anchored top-left, the backend's contents are
+  // unknown after a resize anyway.
+  copy_width = old_width < width ? old_width : width;
+  for (y=0; (y<old_height) && (y<height); y++)
+    memcpy(front + y * width, old_front + y * old_width,
+        sizeof(struct shadow_cell) * copy_width);
+  free(old_front);
+
+  nof_pending_copies = 0;
+  shadow_grid_invalidate();
+}
+
+
+void shadow_grid_invalidate() {
+  if (target == NULL)
+    return;
+
+  fill_cells(back, grid_height * grid_width, SHADOW_UNKNOWN_ATTRIBUTES);
+  mark_all_rows_dirty();
+  target_cursor_y = -1;
+  target_cursor_x = -1;
+  target_style = SHADOW_UNKNOWN_TARGET_VALUE;
+  target_foreground = SHADOW_UNKNOWN_TARGET_VALUE;
+  target_background = SHADOW_UNKNOWN_TARGET_VALUE;
+}
+
@@ -0,0 +1,61 @@
+/* shadow_grid.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef shadow_grid_h_INCLUDED
+#define shadow_grid_h_INCLUDED
+
+#include "../screen_interface/screen_monospace_interface.h"
+
+// The shadow grid is an optional layer between libmonospaceif and the
+// screen backend. All output is written into an in-memory grid of cells
+// and only the cells which differ from what the backend is known to
+// display are sent when "update_screen" is reached.
+
+// Returns the interface which has to be used instead of "target" while
+// the grid is active.
+struct z_screen_monospace_interface *shadow_grid_wrap_interface(
+    struct z_screen_monospace_interface *target, int height, int width);
+
+// Frees the grid and returns the originally wrapped interface.
+struct z_screen_monospace_interface *shadow_grid_unwrap_interface();
+
+void shadow_grid_resize(int height, int width);
+
+// Forget everything known about the backend's screen contents, so the
+// next flush will send every cell.
+void shadow_grid_invalidate();
+
+size_t shadow_grid_get_memory_size();
+
+#endif /* shadow_grid_h_INCLUDED */
+
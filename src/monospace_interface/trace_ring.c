@@ -0,0 +1,155 @@
+/* trace_ring.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "interpreter/fizmo.h"
+
+#include "trace_ring.h"
+
+
+bool trace_ring_enabled = false;
+
+static struct trace_record *records = NULL;
+static uint32_t next_sequence = 0;
+static char *dump_filename = NULL;
+static bool dump_on_exit = false;
+static bool exit_handler_registered = false;
+
+
+// Invoked on every exit. While a story is running, an exit means that the
+// interpreter or the library has given up, so the ring is saved for
+// post-mortem analysis.
+static void dump_at_exit() {
+  if ( (dump_on_exit == true) && (next_sequence > 0) )
+    trace_ring_dump(NULL);
+}
+
+
+void trace_ring_enable(bool enabled) {
+  if ( (enabled == true) && (records == NULL) ) {
+    records = fizmo_malloc(sizeof(struct trace_record) * TRACE_RING_SIZE);
+    next_sequence = 0;
+  }
+
+  if ( (enabled == true) && (exit_handler_registered == false) ) {
+    atexit(&dump_at_exit);
+    exit_handler_registered = true;
+  }
+
+  trace_ring_enabled = enabled;
+}
+
+
+void trace_ring_record(uint16_t type, int32_t a, int32_t b, int32_t c) {
+  struct trace_record *record
+    = &records[next_sequence % TRACE_RING_SIZE];
+
+  record->sequence = next_sequence++;
+  record->type = type;
+  record->reserved = 0;
+  record->a = a;
+  record->b = b;
+  record->c = c;
+}
+
+
+void trace_ring_clear() {
+  next_sequence = 0;
+}
+
+
+void trace_ring_set_dump_filename(char *filename) {
+  free(dump_filename);
+  dump_filename = filename;
+}
+
+
+char *trace_ring_get_dump_filename() {
+  return dump_filename != NULL ? dump_filename : TRACE_RING_DEFAULT_FILENAME;
+}
+
+
+void trace_ring_set_dump_on_exit(bool new_dump_on_exit) {
+  dump_on_exit = new_dump_on_exit;
+}
+
+
+// Writes the contents of the ring to the given file, or to the configured
+// one if filename is NULL. Returns 0 on success and -1 on error.
+int trace_ring_dump(char *filename) {
+  FILE *out;
+  uint32_t header[3], first, nof_records, i;
+  int result = 0;
+
+  if (filename == NULL)
+    filename = trace_ring_get_dump_filename();
+
+  nof_records
+    = next_sequence < TRACE_RING_SIZE ? next_sequence : TRACE_RING_SIZE;
+  first = next_sequence - nof_records;
+
+  TRACE_LOG("Dumping %d trace records to \"%s\".\n", nof_records, filename);
+
+  if ((out = fopen(filename, "wb")) == NULL)
+    return -1;
+
+  header[0] = TRACE_RING_FORMAT_VERSION;
+  header[1] = sizeof(struct trace_record);
+  header[2] = nof_records;
+
+  if ( (fwrite("MTRC", 1, 4, out) != 4)
+      || (fwrite(header, sizeof(uint32_t), 3, out) != 3) )
+    result = -1;
+
+  for (i=0; (i<nof_records) && (result == 0); i++)
+    if (fwrite(&records[(first + i) % TRACE_RING_SIZE],
+          sizeof(struct trace_record), 1, out) != 1)
+      result = -1;
+
+  if (fclose(out) != 0)
+    result = -1;
+
+  return result;
+}
+
+
+size_t trace_ring_get_memory_size() {
+  return records != NULL
+    ? sizeof(struct trace_record) * TRACE_RING_SIZE
+    : 0;
+}
+
@@ -0,0 +1,94 @@
+/* trace_ring.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef trace_ring_h_INCLUDED
+#define trace_ring_h_INCLUDED
+
+#include <stdint.h>
+
+#include "tools/types.h"
+
+// A binary event tracer which can be switched on at runtime. Events are
+// stored as fixed-size records in a ring buffer which keeps the last
+// TRACE_RING_SIZE events. While tracing is disabled, recording an event
+// costs a single flag test.
+//
+// The dump file starts with the four bytes "MTRC", followed by the format
+// version, the size of a record and the number of records as 32-bit values.
+// After that the records follow, oldest first. All values are in host byte
+// order. Only one story can be open per process, and the ring is cleared
+// whenever one is opened, so it only holds the events of that story.
+
+#define TRACE_RING_SIZE 4096
+#define TRACE_RING_FORMAT_VERSION 1
+#define TRACE_RING_DEFAULT_FILENAME "libmonospaceif-trace.bin"
+
+// Event types and the meaning of their a, b and c values:
+#define TRACE_EVENT_WINDOW_OUTPUT   0x01 // window, length, ycursorpos
+#define TRACE_EVENT_MORE_PROMPT     0x02 // window, -, -
+#define TRACE_EVENT_REFRESH_START   0x10 // y_size, y_refresh_top, sb-top-line
+#define TRACE_EVENT_REFRESH_CASE    0x11 // case, y_size, chsl
+#define TRACE_EVENT_REFRESH_END     0x12 // result, chsl, -
+#define TRACE_EVENT_READ_LINE_START 0x20 // maximum_length, tenth_s, preloaded
+#define TRACE_EVENT_READ_LINE_EVENT 0x21 // event_type, input, input_index
+#define TRACE_EVENT_READ_LINE_END   0x22 // input_size, -, -
+
+struct trace_record
+{
+  uint32_t sequence;
+  uint16_t type;
+  uint16_t reserved;
+  int32_t a;
+  int32_t b;
+  int32_t c;
+};
+
+extern bool trace_ring_enabled;
+
+#define TRACE_EVENT(type, a, b, c) \
+  do { \
+    if (trace_ring_enabled == true) \
+      trace_ring_record(type, a, b, c); \
+  } while (0)
+
+void trace_ring_enable(bool enabled);
+void trace_ring_record(uint16_t type, int32_t a, int32_t b, int32_t c);
+void trace_ring_clear();
+void trace_ring_set_dump_filename(char *filename);
+char *trace_ring_get_dump_filename();
+void trace_ring_set_dump_on_exit(bool dump_on_exit);
+int trace_ring_dump(char *filename);
+size_t trace_ring_get_memory_size();
+
+#endif /* trace_ring_h_INCLUDED */
+
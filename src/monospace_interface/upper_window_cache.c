@@ -0,0 +1,221 @@
+/* upper_window_cache.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+
+#include "tools/tracelog.h"
+#include "tools/types.h"
+#include "interpreter/blockbuf.h"
+#include "interpreter/fizmo.h"
+
+#include "upper_window_cache.h"
+
+
+struct upper_window_run
+{
+  z_style style;
+  z_colour foreground;
+  z_colour background;
+  int text_index;
+};
+
+struct upper_window_row
+{
+  bool dirty;
+  int nof_runs;
+  struct upper_window_run *runs;
+  z_ucs *text;
+};
+
+static struct upper_window_row *rows = NULL;
+static struct upper_window_run *run_storage = NULL;
+static z_ucs *text_storage = NULL;
+static int nof_rows_allocated = 0;
+static int width_allocated = 0;
+
+
+void upper_window_cache_mark_row_dirty(int row) {
+  if ( (row >= 1) && (row <= nof_rows_allocated) )
+    rows[row - 1].dirty = true;
+}
+
+
+void upper_window_cache_invalidate() {
+  int i;
+
+  for (i=0; i<nof_rows_allocated; i++)
+    rows[i].dirty = true;
+}
+
+
+// Every run holds at least one cell and its text is terminated by a 0, so
+// a row needs at most "width" runs and "2 * width" characters.
+static void allocate_rows(int nof_rows, int width) {
+  int i;
+
+  TRACE_LOG("Allocating upper window cache for %dx%d.\n", width, nof_rows);
+
+  upper_window_cache_free();
+
+  rows = fizmo_malloc(sizeof(struct upper_window_row) * nof_rows);
+  run_storage = fizmo_malloc(
+      sizeof(struct upper_window_run) * nof_rows * width);
+  text_storage = fizmo_malloc(sizeof(z_ucs) * nof_rows * width * 2);
+
+  for (i=0; i<nof_rows; i++) {
+    rows[i].dirty = true;
+    rows[i].nof_runs = 0;
+    rows[i].runs = run_storage + i * width;
+    rows[i].text = text_storage + i * width * 2;
+  }
+
+  nof_rows_allocated = nof_rows;
+  width_allocated = width;
+}
+
+
+// A colour of 0 in the block buffer means "keep the current colour", so
+// such a cell may be appended to any run.
+static void encode_row(int row_index, int width) {
+  struct upper_window_row *row = &rows[row_index];
+  struct upper_window_run *run = NULL;
+  struct blockbuf_char *cell;
+  int block_index = row_index * upper_window_buffer->width;
+  int text_index = 0, x;
+
+  row->nof_runs = 0;
+
+  for (x=0; x<width; x++) {
+    cell = &upper_window_buffer->content[block_index + x];
+
+    if ( (run == NULL)
+        || (cell->style != run->style)
+        || ( (cell->foreground_colour != run->foreground)
+          && (cell->foreground_colour != 0) )
+        || ( (cell->background_colour != run->background)
+          && (cell->background_colour != 0) ) ) {
+      if (run != NULL)
+        row->text[text_index++] = 0;
+      run = &row->runs[row->nof_runs++];
+      run->style = cell->style;
+      run->foreground = cell->foreground_colour;
+      run->background = cell->background_colour;
+      run->text_index = text_index;
+    }
+
+    row->text[text_index++] = cell->character;
+  }
+
+  if (run != NULL)
+    row->text[text_index] = 0;
+
+  row->dirty = false;
+}
+
+
+// Redraws the upper window. The current output style and colours are
+// read from and stored to the given variables, just like the library does
+// for all other output.
+void upper_window_cache_redraw(
+    struct z_screen_monospace_interface *screen_interface,
+    int nof_rows, int width, int top_y, bool using_colors,
+    z_style *text_style, z_colour *foreground, z_colour *background) {
+  struct upper_window_run *run;
+  int i, j;
+
+  if (width > upper_window_buffer->width)
+    width = upper_window_buffer->width;
+
+  if ( (nof_rows < 1) || (width < 1) )
+    return;
+
+  if ( (nof_rows != nof_rows_allocated) || (width != width_allocated) )
+    allocate_rows(nof_rows, width);
+
+  for (i=0; i<nof_rows; i++)
+    if (rows[i].dirty == true)
+      encode_row(i, width);
+
+  *text_style = rows[0].runs[0].style;
+  *foreground = rows[0].runs[0].foreground;
+  *background = rows[0].runs[0].background;
+
+  screen_interface->set_text_style(*text_style);
+  if (using_colors == true)
+    screen_interface->set_colour(*foreground, *background);
+
+  for (i=0; i<nof_rows; i++) {
+    screen_interface->goto_yx(top_y + i, 1);
+
+    for (j=0; j<rows[i].nof_runs; j++) {
+      run = &rows[i].runs[j];
+
+      if (run->style != *text_style) {
+        *text_style = run->style;
+        screen_interface->set_text_style(*text_style);
+      }
+
+      if ( ( (run->foreground != *foreground) && (run->foreground != 0) )
+          || ( (run->background != *background) && (run->background != 0) ) ) {
+        if (run->foreground != 0)
+          *foreground = run->foreground;
+        if (run->background != 0)
+          *background = run->background;
+        if (using_colors == true)
+          screen_interface->set_colour(*foreground, *background);
+      }
+
+      screen_interface->z_ucs_output(rows[i].text + run->text_index);
+    }
+  }
+}
+
+
+size_t upper_window_cache_get_memory_size() {
+  return nof_rows_allocated * (sizeof(struct upper_window_row)
+      + width_allocated * (sizeof(struct upper_window_run)
+        + 2 * sizeof(z_ucs)));
+}
+
+
+void upper_window_cache_free() {
+  free(rows);
+  free(run_storage);
+  free(text_storage);
+  rows = NULL;
+  run_storage = NULL;
+  text_storage = NULL;
+  nof_rows_allocated = 0;
+  width_allocated = 0;
+}
+
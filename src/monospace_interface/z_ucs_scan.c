@@ -0,0 +1,115 @@
+/* z_ucs_scan.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define Z_UCS_SCAN_SSE2
+#endif
+
+#include "tools/types.h"
+
+#include "z_ucs_scan.h"
+
+
+#if defined(Z_UCS_SCAN_SSE2)
+
+// The vector loop for the terminator search only uses aligned loads, which
+// never cross a page boundary and thus may read the few chars behind the
+// terminator without faulting. The sanitizers can't know that, so they
+// are told to leave this function alone.
+#if defined(__clang__)
+#define Z_UCS_SCAN_NO_SANITIZE __attribute__((no_sanitize("address", "memory")))
+#else
+#define Z_UCS_SCAN_NO_SANITIZE __attribute__((no_sanitize_address))
+#endif
+
+Z_UCS_SCAN_NO_SANITIZE
+z_ucs *z_ucs_scan_end(z_ucs *string) {
+  __m128i zero = _mm_setzero_si128();
+  int mask;
+
+  while (((uintptr_t)string & 15) != 0) {
+    if (*string == 0)
+      return string;
+    string++;
+  }
+
+  for (;;) {
+    mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_load_si128((__m128i*)string), zero)));
+    if (mask != 0)
+      return string + __builtin_ctz(mask);
+    string += 4;
+  }
+}
+
+
+z_ucs *z_ucs_scan_chr(z_ucs *start, z_ucs *end, z_ucs c) {
+  __m128i pattern = _mm_set1_epi32((int)c);
+  int mask;
+
+  while (end - start >= 4) {
+    mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_loadu_si128((__m128i*)start), pattern)));
+    if (mask != 0)
+      return start + __builtin_ctz(mask);
+    start += 4;
+  }
+
+  while ( (start < end) && (*start != c) )
+    start++;
+
+  return start;
+}
+
+#else
+
+z_ucs *z_ucs_scan_end(z_ucs *string) {
+  while (*string != 0)
+    string++;
+
+  return string;
+}
+
+
+z_ucs *z_ucs_scan_chr(z_ucs *start, z_ucs *end, z_ucs c) {
+  while ( (start < end) && (*start != c) )
+    start++;
+
+  return start;
+}
+
+#endif
+
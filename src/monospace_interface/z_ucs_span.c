@@ -0,0 +1,68 @@
+/* z_ucs_span.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2023 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "tools/types.h"
+
+#include "z_ucs_span.h"
+
+
+// Number of chars copied at once for backends without "z_ucs_output_n".
+#define Z_UCS_SPAN_CHUNK_SIZE 128
+
+
+void z_ucs_span_output(struct z_screen_monospace_interface *screen,
+    const z_ucs *text, size_t length) {
+  z_ucs chunk[Z_UCS_SPAN_CHUNK_SIZE + 1];
+  size_t chunk_length;
+
+  if (length == 0)
+    return;
+
+  if (screen->z_ucs_output_n != NULL) {
+    screen->z_ucs_output_n(text, length);
+    return;
+  }
+
+  while (length > 0) {
+    chunk_length
+      = length > Z_UCS_SPAN_CHUNK_SIZE ? Z_UCS_SPAN_CHUNK_SIZE : length;
+    memcpy(chunk, text, sizeof(z_ucs) * chunk_length);
+    chunk[chunk_length] = 0;
+    screen->z_ucs_output(chunk);
+    text += chunk_length;
+    length -= chunk_length;
+  }
+}
+
@@ -56,6 +56,39 @@
 #define EVENT_WAS_CODE_PAGE_DOWN    0x400A
 #define EVENT_WAS_CODE_ESC          0x400B
 
+#define DRAW_OP_GOTO_YX             0x01
+#define DRAW_OP_TEXT                0x02
+#define DRAW_OP_SET_COLOUR          0x03
+#define DRAW_OP_COPY_AREA           0x04
+#define DRAW_OP_CLEAR_TO_EOL        0x05
+#define DRAW_OP_CLEAR_AREA          0x06
+
+// A single drawing operation as passed to "draw_ops". Which of the fields
+// are used depends on the operation type:
+// DRAW_OP_GOTO_YX: y, x
+// DRAW_OP_TEXT: text (not zero-terminated), text_length, text_style
+// DRAW_OP_SET_COLOUR: foreground, background
+// DRAW_OP_COPY_AREA: y, x (destination), srcy, srcx, height, width
+// DRAW_OP_CLEAR_TO_EOL: text_style
+// DRAW_OP_CLEAR_AREA: y, x, height, width, text_style
+struct z_screen_draw_op
+{
+  int type;
+  int y, x;
+  int srcy, srcx;
+  int height, width;
+  z_style text_style;
+  z_colour foreground, background;
+  z_ucs *text;
+  int text_length;
+};
+
+// Members marked as optional may be NULL. Version 0.10.0 appended the
+// optional members "draw_ops", "scroll_region", "z_ucs_output_n" and
+// "keeps_contents_on_resize". A backend compiled against the 0.9 header
+// passes a shorter struct, which libmonospaceif would read past, so all
+// backends have to be recompiled. Members missing from an initializer
+// are NULL then, which is what unimplemented optional members need to be.
 struct z_screen_monospace_interface
 {
   void (*goto_yx)(int y, int x);
@@ -94,6 +127,27 @@ struct z_screen_monospace_interface
       char *directory, int filetype_or_mode, int fileaccess); // optional
   // UI-specific filename dialog. If not implemented, return -3. Return >=0 on
   // k, -1 on error or -2 in case user cancelled (ESC or similar).
+  void (*draw_ops)(struct z_screen_draw_op *ops, int nof_ops); // optional
+  // If implemented, libmonospaceif collects all drawing operations and
+  // passes them in one call before "update_screen" and before waiting for
+  // input. The text pointers are only valid during the call.
+  void (*scroll_region)(int top, int bottom, int lines); // optional
+  // Scrolls the full-width rows "top" to "bottom" (inclusive) up by "lines"
+  // rows, or down for negative values, as done by terminal scroll regions
+  // or insert/delete line. The rows vacated are cleared using the current
+  // colours. If implemented, it's used instead of "copy_area" wherever a
+  // window spanning the whole screen width is scrolled. Added in 0.10.0,
+  // has to be NULL if not implemented.
+  void (*z_ucs_output_n)(const z_ucs *z_ucs_output, size_t length);
+  // optional. Outputs "length" chars, which are not zero-terminated. If not
+  // implemented, libmonospaceif copies the text into terminated chunks for
+  // "z_ucs_output". Added in 0.10.0, has to be NULL if not implemented.
+  bool (*keeps_contents_on_resize)();
+  // optional. Returns true if the screen contents stay anchored top-left
+  // when the screen is resized, as done by curses. Only then a change of
+  // the screen height is handled by shifting the lower window instead of
+  // redrawing everything. Added in 0.10.0, has to be NULL if not
+  // implemented.
 };
 
 #endif /* screen_monospace_interface_h_INCLUDED */